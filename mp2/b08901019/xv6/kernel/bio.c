@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -23,14 +23,25 @@
 #include "fs.h"
 #include "buf.h"
 
+// Buffers are hashed by (dev, blockno) into NBUCKET buckets,
+// each with its own lock, so lookups of different blocks
+// rarely contend. bcache.lock only serializes recycling a
+// buffer from one bucket into another; brelse() stamps each
+// buffer with the time CSR (ticks don't advance while harts
+// are idle) so that recycling picks the least recently used
+// free buffer.
+#define NBUCKET 13
+#define BHASH(dev, blockno) ((((dev) << 27) | (blockno)) % NBUCKET)
+
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // Each bucket is a list of buffers through prev/next.
+  struct {
+    struct spinlock lock;
+    struct buf head;
+  } bucket[NBUCKET];
 } bcache;
 
 void
@@ -39,53 +50,114 @@ binit(void)
   struct buf *b;
 
   initlock(&bcache.lock, "bcache");
+  for(int i = 0; i < NBUCKET; i++){
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+    bcache.bucket[i].head.prev = &bcache.bucket[i].head;
+    bcache.bucket[i].head.next = &bcache.bucket[i].head;
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Start with all buffers in bucket 0.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+    b->next = bcache.bucket[0].head.next;
+    b->prev = &bcache.bucket[0].head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bcache.bucket[0].head.next->prev = b;
+    bcache.bucket[0].head.next = b;
   }
 }
 
+// Find the cached buffer for (dev, blockno) in bucket id.
+// Caller must hold that bucket's lock.
+static struct buf*
+bfind(int id, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.bucket[id].head.next; b != &bcache.bucket[id].head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  }
+  return 0;
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
-
-  acquire(&bcache.lock);
+  struct buf *b, *victim;
+  int id = BHASH(dev, blockno);
+  int vid;
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  acquire(&bcache.bucket[id].lock);
+  if((b = bfind(id, dev, blockno)) != 0){
+    b->refcnt++;
+    release(&bcache.bucket[id].lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bcache.bucket[id].lock);
+
+  // Not cached. Only one process at a time may move buffers
+  // between buckets, so check again under bcache.lock in case
+  // someone else cached the block in the meantime.
+  acquire(&bcache.lock);
+  acquire(&bcache.bucket[id].lock);
+  if((b = bfind(id, dev, blockno)) != 0){
+    b->refcnt++;
+    release(&bcache.bucket[id].lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bcache.bucket[id].lock);
 
-  // Not cached.
   // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  // Keep the lock of the bucket holding the best candidate
+  // so far; only this process holds more than one bucket
+  // lock, so this cannot deadlock.
+  victim = 0;
+  vid = -1;
+  for(int i = 0; i < NBUCKET; i++){
+    int found = 0;
+    acquire(&bcache.bucket[i].lock);
+    for(b = bcache.bucket[i].head.next; b != &bcache.bucket[i].head; b = b->next){
+      if(b->refcnt == 0 && (victim == 0 || b->timestamp < victim->timestamp)){
+        victim = b;
+        found = 1;
+      }
     }
+    if(found){
+      if(vid >= 0)
+        release(&bcache.bucket[vid].lock);
+      vid = i;
+    } else {
+      release(&bcache.bucket[i].lock);
+    }
+  }
+  if(victim == 0)
+    panic("bget: no buffers");
+
+  victim->dev = dev;
+  victim->blockno = blockno;
+  victim->valid = 0;
+  victim->refcnt = 1;
+  if(vid != id){
+    victim->next->prev = victim->prev;
+    victim->prev->next = victim->next;
+    release(&bcache.bucket[vid].lock);
+    acquire(&bcache.bucket[id].lock);
+    victim->next = bcache.bucket[id].head.next;
+    victim->prev = &bcache.bucket[id].head;
+    bcache.bucket[id].head.next->prev = victim;
+    bcache.bucket[id].head.next = victim;
   }
-  panic("bget: no buffers");
+  release(&bcache.bucket[id].lock);
+  release(&bcache.lock);
+  acquiresleep(&victim->lock);
+  return victim;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -112,66 +184,87 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Record when it was last used, for LRU recycling.
 void
 brelse(struct buf *b)
 {
+  int id;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  id = BHASH(b->dev, b->blockno);
+  acquire(&bcache.bucket[id].lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->timestamp = r_time();
   }
-  
-  release(&bcache.lock);
+  release(&bcache.bucket[id].lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int id = BHASH(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[id].lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bcache.bucket[id].lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int id = BHASH(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[id].lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bcache.bucket[id].lock);
 }
 
 /* NTU OS 2022 */
-/* Write 4096 bytes page to the eight consecutive 512-byte blocks starting at blk. */
+/* Write a 4096-byte page to the BPP consecutive blocks starting at blk. */
+/* Swap pages bypass the buffer cache: the whole page goes out */
+/* as one disk request. */
 void write_page_to_disk(uint dev, char *page, uint blk) {
-  for (int i = 0; i < 8; i++) {
-    // disk
-    int offset = i * 512;
-    int blk_idx = blk + i;
-    struct buf *buffer = bget(ROOTDEV, blk_idx);
-    memmove(buffer->data, page + offset, 512);
-    bwrite(buffer);
-    brelse(buffer);
-  }
+  struct pgreq r;
+
+  r.npages = 1;
+  r.pages[0] = page;
+  write_pages_start(&r, blk);
+  pages_wait(&r);
 }
 
 /* NTU OS 2022 */
-/* Read 4096 bytes from the eight consecutive 512-byte blocks starting at blk into page. */
+/* Read 4096 bytes from the BPP consecutive blocks starting at blk into page. */
 void read_page_from_disk(uint dev, char *page, uint blk) {
-  for (int i = 0; i < 8; i++) {
-    int offset = i * 512;
-    int blk_idx = blk + i;
-    struct buf *buffer = bread(ROOTDEV, blk_idx);
-    memmove(page + offset, buffer->data, 512);
-    brelse(buffer);
-  }
+  struct pgreq r;
+
+  r.npages = 1;
+  r.pages[0] = page;
+  read_pages(&r, blk);
+}
+
+/* Read the r->npages*BPP consecutive blocks starting at blk */
+/* into the r->npages pages in r->pages, as one disk request, */
+/* and wait for it to finish. */
+void read_pages(struct pgreq *r, uint blk) {
+  r->sector = blk * (BSIZE / 512);
+  virtio_disk_submit_pages(r, 0);
+  pages_wait(r);
+}
+
+/* Start writing the r->npages pages in r->pages to the */
+/* r->npages*BPP consecutive blocks starting at blk, as one */
+/* disk request. Returns without waiting; the pages must not */
+/* be freed or reused until pages_wait(r) returns. */
+void write_pages_start(struct pgreq *r, uint blk) {
+  r->sector = blk * (BSIZE / 512);
+  virtio_disk_submit_pages(r, 1);
+}
+
+/* Wait for a request started by write_pages_start(). */
+void pages_wait(struct pgreq *r) {
+  virtio_disk_wait_pages(r);
 }
@@ -5,8 +5,19 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  uint64 timestamp; // time CSR at last brelse(), for LRU
+  struct buf *prev; // hash bucket list
   struct buf *next;
   uchar data[BSIZE];
 };
 
+
+// A multi-page disk request, used for swap I/O.
+// See virtio_disk_submit_pages().
+struct pgreq {
+  int disk;             // does disk "own" the request?
+  int idx;              // first descriptor of the chain
+  uint64 sector;        // first 512-byte sector
+  int npages;
+  char *pages[NPGREQ];  // page-aligned kernel addresses
+};
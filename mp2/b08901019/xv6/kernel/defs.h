@@ -2,12 +2,15 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct pgreq;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct swapra_stat;
+struct faultstat;
 
 // bio.c
 void            binit(void);
@@ -18,6 +21,9 @@ void            bpin(struct buf*);
 void            bunpin(struct buf*);
 void write_page_to_disk(uint dev, char *pg, uint blk);
 void read_page_from_disk(uint dev, char *pg, uint blk);
+void            read_pages(struct pgreq*, uint);
+void            write_pages_start(struct pgreq*, uint);
+void            pages_wait(struct pgreq*);
 
 // console.c
 void            consoleinit(void);
@@ -55,8 +61,8 @@ int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
-uint balloc_page(uint dev);
-void bfree_page(int dev, uint b);
+uint swapalloc(int n, int *got);
+void swapfree(uint b);
 // ramdisk.c
 void            ramdiskinit(void);
 void            ramdiskintr(void);
@@ -66,6 +72,13 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kaddref(void *);
+int             krefcnt(void *);
+void*           kalloc_zeroed(void);
+void            kzero_refill(void);
+void*           superalloc(void);
+void            superfree(void *);
+void*           ksplit(void *);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -104,6 +117,9 @@ void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
+int             schedtick(void);
+void            mlfq_boost(void);
+int             setnice(struct proc*, int);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -118,6 +134,9 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+#ifdef LAB_LOCK
+int             statslock(char*, int);
+#endif
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -142,8 +161,16 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+void            timersinit(void);
+void            timer_arm(void);
+void            timer_kick(int);
+int             tsleep(uint64);
+int             timerintr(void);
+
 // trap.c
 extern uint     ticks;
+void            clockintr(void);
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
@@ -174,8 +201,12 @@ int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 pte_t *walk(pagetable_t pagetable, uint64 va, int alloc);
+pte_t *         walksuper(pagetable_t, uint64);
+int             mapsuper(pagetable_t, uint64, uint64, int);
+void            demote(pte_t *);
 void vmprint(pagetable_t pagetable);
 int madvise(uint64 va, uint64 length, int advice);
+int swapout_start(struct pgreq *r, pte_t **ptes);
 
 
 // plic.c
@@ -188,9 +219,27 @@ void            plic_complete(int);
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_submit_pages(struct pgreq *, int);
+void            virtio_disk_wait_pages(struct pgreq *);
 
 // paging.c
 int handle_pgfault();
+int             swapra(int, struct swapra_stat*);
+int             reclaim(struct proc*, int);
+int             faultstat(struct proc*, int, struct faultstat*);
+void*           ukalloc(void);
+void*           ukalloc_zeroed(void);
+int             iscow(pagetable_t, uint64);
+int             cowfault(pagetable_t, uint64, int);
+void            prefault(uint64, uint64, int);
+
+#ifdef LAB_LOCK
+// stats.c
+void            statsinit(void);
+
+// sprintf.c
+int             snprintf(char*, int, char*, ...);
+#endif
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -91,6 +91,7 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
+    prefault(addr, sizeof(st), 1);
     ilock(f->ip);
     stati(f->ip, &st);
     iunlock(f->ip);
@@ -110,6 +111,8 @@ fileread(struct file *f, uint64 addr, int n)
 
   if(f->readable == 0)
     return -1;
+  // pipes and devices copy out under a spinlock.
+  prefault(addr, n, 1);
 
   if(f->type == FD_PIPE){
     r = piperead(f->pipe, addr, n);
@@ -138,6 +141,8 @@ filewrite(struct file *f, uint64 addr, int n)
 
   if(f->writable == 0)
     return -1;
+  // pipes and devices copy in under a spinlock.
+  prefault(addr, n, 0);
 
   if(f->type == FD_PIPE){
     ret = pipewrite(f->pipe, addr, n);
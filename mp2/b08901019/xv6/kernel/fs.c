@@ -26,6 +26,8 @@
 // only one device
 struct superblock sb; 
 
+static void swapinit(struct superblock *sb);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +46,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit(&sb);
 }
 
 // Zero a block.
@@ -673,54 +676,77 @@ nameiparent(char *path, char *name)
   return namex(path, 1, name);
 }
 
-/* NTU OS 2022 */
-/* Similar to balloc, except allocates eight consecutive free blocks. */
-uint balloc_page(uint dev) {
-  for (int b = 0; b < sb.size; b += BPB) {
-    struct buf *bp = bread(dev, BBLOCK(b, sb));
-
-    for (int bi = 0; bi < BPB && b + bi < sb.size; bi += 8) {
-      uchar *bits = &bp->data[bi / 8];
-      if (*bits == 0) {
-        *bits |= 0xff; // Mark 8 consecutive blocks in use.
-        log_write(bp);
-        brelse(bp);
+// Swap area.
+//
+// Swapped-out pages live in a region of sb.nswap blocks after
+// the file system, starting at sb.swapstart, cut into slots of
+// BPP blocks each. Nothing in it outlives a reboot, so which
+// slots are free is kept only in memory: allocating and freeing
+// a slot never touches the log, the bitmap or the buffer cache.
 
-        for (int i = 0; i < 8; i += 1) {
-          bzero(dev, b + bi + i);
-        }
+#define NSWAPSLOT (SWAPSIZE / BPP)
 
-        uint blockno = b + bi;
-        return blockno;
-      }
-    }
+struct {
+  struct spinlock lock;
+  uint nslot;                  // usable slots, from the superblock
+  uint hint;                   // slot to start the next search at
+  uchar used[NSWAPSLOT / 8];   // one bit per slot
+} swap;
 
-    brelse(bp);
-  }
-  panic("balloc_page: out of blocks");
+static void
+swapinit(struct superblock *sb)
+{
+  initlock(&swap.lock, "swap");
+  swap.nslot = sb->nswap / BPP;
+  if(swap.nslot > NSWAPSLOT)
+    swap.nslot = NSWAPSLOT;
+  swap.hint = 0;
 }
 
 /* NTU OS 2022 */
-/* Free 8 disk blocks allocated from balloc_page(). */
-void bfree_page(int dev, uint blockno) {
-  if (blockno + 8 > sb.size) {
-    panic("bfree_page: blockno out of bound");
-  }
-
-  if ((blockno % 8) != 0) {
-    panic("bfree_page: blockno is not aligned");
-  }
-
-  int bi = blockno % BPB;
-  int b = blockno - bi;
-  struct buf *bp = bread(dev, BBLOCK(b, sb));
-  uchar *bits = &bp->data[bi / 8];
-
-  if (*bits != 0xff) {
-    panic("bfree_page: data bits are invalid");
+/* Allocate up to n consecutive swap slots and return the first */
+/* block number of the first one. *got is set to the number of */
+/* slots actually allocated, or 0 if swap is full, in which */
+/* case 0 is returned. Block 0 is never part of the swap area. */
+uint swapalloc(int n, int *got) {
+  uint start, run, s;
+
+  acquire(&swap.lock);
+  for (uint i = 0; i < swap.nslot; i++) {
+    start = (swap.hint + i) % swap.nslot;
+    if (swap.used[start / 8] & (1 << (start % 8)))
+      continue;
+    // extend the run of free slots, without wrapping around.
+    for (run = 1; run < n && start + run < swap.nslot; run++) {
+      s = start + run;
+      if (swap.used[s / 8] & (1 << (s % 8)))
+        break;
+    }
+    for (s = start; s < start + run; s++)
+      swap.used[s / 8] |= 1 << (s % 8);
+    swap.hint = (start + run) % swap.nslot;
+    release(&swap.lock);
+    *got = run;
+    return sb.swapstart + start * BPP;
   }
+  release(&swap.lock);
+  *got = 0;
+  return 0;
+}
 
-  *bits = 0;
-  log_write(bp);
-  brelse(bp);
+/* NTU OS 2022 */
+/* Free a swap slot allocated by swapalloc(). */
+void swapfree(uint blockno) {
+  if (blockno < sb.swapstart || (blockno - sb.swapstart) % BPP != 0)
+    panic("swapfree: bad blockno");
+
+  uint s = (blockno - sb.swapstart) / BPP;
+  if (s >= swap.nslot)
+    panic("swapfree: blockno out of bound");
+
+  acquire(&swap.lock);
+  if ((swap.used[s / 8] & (1 << (s % 8))) == 0)
+    panic("swapfree: slot is not in use");
+  swap.used[s / 8] &= ~(1 << (s % 8));
+  release(&swap.lock);
 }
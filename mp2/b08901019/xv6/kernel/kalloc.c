@@ -1,6 +1,29 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Each hart keeps its own free list so that kalloc() and
+// kfree() normally only touch a lock no other hart wants.
+// A hart whose list runs dry refills KMEM_BATCH pages at a
+// time from a shared pool, and one whose list grows past
+// 2*KMEM_BATCH hands a batch back. If the pool is empty too,
+// kalloc() steals half of another hart's list.
+//
+// Pages may be shared copy-on-write between processes, so
+// each page carries a reference count; kfree() only puts a
+// page back on a free list when its last reference is dropped.
+//
+// Aligned 2 MiB chunks of free memory start out on a separate
+// list of superpages, handed out by superalloc(). When the
+// 4 KiB lists run dry, kalloc() breaks a superpage up into
+// ordinary pages; those are never merged back. Each superpage
+// handed out comes with a reserved page, which ksplit() returns
+// as the page-table page for its 512 pieces, so splitting one
+// never needs memory that may have run out.
+//
+// Idle harts keep a pool of up to NZERO pre-zeroed pages
+// topped up (see kzero_refill()), so kalloc_zeroed() can
+// usually skip the memset on page-fault paths.
 
 #include "types.h"
 #include "param.h"
@@ -9,6 +32,9 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define KMEM_BATCH 32  // pages moved between a hart and the pool at once
+#define NZERO      64  // pre-zeroed pages kept by idle harts
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -18,16 +44,48 @@ struct run {
   struct run *next;
 };
 
-struct {
+struct kmem {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;
+};
+
+struct kmem kmem[NCPU];  // per-hart free lists
+struct kmem kpool;       // shared pool that refills them
+struct kmem ksuper;      // free superpages
+struct kmem kzero;       // pre-zeroed pages, allocated but unused
+struct kmem kresv;       // one page per superpage handed out
+
+// Reference count of each physical page, indexed by
+// (pa - KERNBASE) / PGSIZE. Updated with atomic adds,
+// since sharers may fork and fault on different harts.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+static int kref[(PHYSTOP - KERNBASE) / PGSIZE];
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kmem[i].lock, "kmem");
+  initlock(&kpool.lock, "kmem_pool");
+  initlock(&ksuper.lock, "kmem_super");
+  initlock(&kzero.lock, "kmem_zero");
+  initlock(&kresv.lock, "kmem_resv");
+
+  char *first = (char*)SUPERPGROUNDUP((uint64)end);
+  char *last = (char*)SUPERPGROUNDDOWN(PHYSTOP);
+  if(first >= last){
+    freerange(end, (void*)PHYSTOP);
+    return;
+  }
+  freerange(end, first);
+  for(char *p = first; p < last; p += SUPERPGSIZE){
+    // no reserved page yet, so not superfree().
+    ((struct run*)p)->next = ksuper.freelist;
+    ksuper.freelist = (struct run*)p;
+    ksuper.nfree++;
+  }
+  freerange(last, (void*)PHYSTOP);
 }
 
 void
@@ -35,31 +93,144 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kref[PA2REF(p)] = 1;
     kfree(p);
+  }
+}
+
+// Detach up to n pages from the front of km's free list
+// and return them as a chain. Caller must hold km->lock.
+static struct run*
+takepages(struct kmem *km, int n, int *got)
+{
+  struct run *head, *r;
+  int i;
+
+  head = km->freelist;
+  if(head == 0){
+    *got = 0;
+    return 0;
+  }
+  r = head;
+  for(i = 1; i < n && r->next; i++)
+    r = r->next;
+  km->freelist = r->next;
+  km->nfree -= i;
+  r->next = 0;
+  *got = i;
+  return head;
+}
+
+// Prepend a chain of n pages ending at tail to km's free list.
+// Caller must hold km->lock.
+static void
+putpages(struct kmem *km, struct run *head, struct run *tail, int n)
+{
+  tail->next = km->freelist;
+  km->freelist = head;
+  km->nfree += n;
+}
+
+// Fetch a batch of pages for hart id, first from the pool and
+// then by stealing from another hart. Holds at most one
+// kmem lock at a time, so there is no lock ordering to get wrong.
+static struct run*
+refill(int id, int *got)
+{
+  struct run *r;
+
+  acquire(&kpool.lock);
+  r = takepages(&kpool, KMEM_BATCH, got);
+  release(&kpool.lock);
+  if(r)
+    return r;
+
+  for(int i = 1; i < NCPU; i++){
+    struct kmem *victim = &kmem[(id + i) % NCPU];
+    acquire(&victim->lock);
+    r = takepages(victim, (victim->nfree + 1) / 2, got);
+    release(&victim->lock);
+    if(r)
+      return r;
+  }
+
+  // last resort: break up a superpage.
+  acquire(&ksuper.lock);
+  r = takepages(&ksuper, 1, got);
+  release(&ksuper.lock);
+  if(r){
+    char *pa = (char*)r;
+    for(int i = 0; i < 511; i++)
+      ((struct run*)(pa + i*PGSIZE))->next = (struct run*)(pa + (i+1)*PGSIZE);
+    ((struct run*)(pa + 511*PGSIZE))->next = 0;
+    *got = 512;
+    return r;
+  }
+  return 0;
+}
+
+// Add a reference to a page returned by kalloc(),
+// e.g. when fork() shares it copy-on-write.
+void
+kaddref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kaddref");
+  __sync_fetch_and_add(&kref[PA2REF(pa)], 1);
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
+// Return the number of references to page pa.
+int
+krefcnt(void *pa)
+{
+  return kref[PA2REF(pa)];
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed when its last reference goes away.
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *spill;
+  struct kmem *km;
+  int n, ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((ref = __sync_sub_and_fetch(&kref[PA2REF(pa)], 1)) > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  km = &kmem[cpuid()];
+  acquire(&km->lock);
+  r->next = km->freelist;
+  km->freelist = r;
+  km->nfree++;
+  spill = 0;
+  if(km->nfree > 2*KMEM_BATCH)
+    spill = takepages(km, KMEM_BATCH, &n);
+  release(&km->lock);
+  pop_off();
+
+  if(spill){
+    for(r = spill; r->next; r = r->next)
+      ;
+    acquire(&kpool.lock);
+    putpages(&kpool, spill, r, n);
+    release(&kpool.lock);
+  }
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +239,159 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  struct run *r, *rest, *tail;
+  struct kmem *km;
+  int id, n;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  km = &kmem[id];
+  acquire(&km->lock);
+  r = km->freelist;
+  if(r){
+    km->freelist = r->next;
+    km->nfree--;
+  }
+  release(&km->lock);
 
-  if(r)
+  if(r == 0 && (r = refill(id, &n)) != 0){
+    // keep the first page, stash the rest locally.
+    rest = r->next;
+    if(rest){
+      for(tail = rest; tail->next; tail = tail->next)
+        ;
+      acquire(&km->lock);
+      putpages(km, rest, tail, n - 1);
+      release(&km->lock);
+    }
+  }
+  pop_off();
+
+  if(r == 0){
+    // out of memory: the zeroed pool is fair game.
+    acquire(&kzero.lock);
+    r = takepages(&kzero, 1, &n);
+    release(&kzero.lock);
+  }
+
+  if(r){
+    kref[PA2REF(r)] = 1;
     memset((char*)r, 5, PGSIZE); // fill with junk
+  }
   return (void*)r;
 }
+
+// Allocate one 2 MiB superpage of physical memory, aligned
+// to 2 MiB, and reserve a page for ksplit(). Returns 0 if
+// either has run out; the contents are not initialized.
+void *
+superalloc(void)
+{
+  struct run *r, *pt;
+  int n;
+
+  acquire(&ksuper.lock);
+  r = takepages(&ksuper, 1, &n);
+  release(&ksuper.lock);
+  if(r == 0)
+    return 0;
+  if((pt = kalloc()) == 0){
+    acquire(&ksuper.lock);
+    putpages(&ksuper, r, r, 1);
+    release(&ksuper.lock);
+    return 0;
+  }
+  acquire(&kresv.lock);
+  putpages(&kresv, pt, pt, 1);
+  release(&kresv.lock);
+  kref[PA2REF(r)] = 1;
+  return (void*)r;
+}
+
+// Take back one reserved page.
+static void *
+unreserve(void)
+{
+  struct run *r;
+  int n;
+
+  acquire(&kresv.lock);
+  r = takepages(&kresv, 1, &n);
+  release(&kresv.lock);
+  if(r == 0)
+    panic("unreserve");
+  return (void*)r;
+}
+
+// Drop a reference to a superpage returned by superalloc(),
+// freeing it and its reserved page with the last one.
+void
+superfree(void *pa)
+{
+  struct run *r;
+  int ref;
+
+  if(((uint64)pa % SUPERPGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("superfree");
+
+  if((ref = __sync_sub_and_fetch(&kref[PA2REF(pa)], 1)) > 0)
+    return;
+  if(ref < 0)
+    panic("superfree: ref");
+
+  r = (struct run*)pa;
+  acquire(&ksuper.lock);
+  putpages(&ksuper, r, r, 1);
+  release(&ksuper.lock);
+  kfree(unreserve());
+}
+
+// Turn an allocated superpage into 512 ordinary pages,
+// each of which must then be freed with kfree(). Returns
+// its reserved page, to hold the page table that maps them.
+void *
+ksplit(void *pa)
+{
+  if(((uint64)pa % SUPERPGSIZE) != 0 || krefcnt(pa) != 1)
+    panic("ksplit");
+  for(int i = 1; i < 512; i++)
+    kref[PA2REF((char*)pa + i*PGSIZE)] = 1;
+  return unreserve();
+}
+
+// Allocate one zero-filled page of physical memory.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+  int n;
+
+  acquire(&kzero.lock);
+  r = takepages(&kzero, 1, &n);
+  release(&kzero.lock);
+  if(r){
+    r->next = 0;  // the only word that isn't zero
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Zero a few pages for kalloc_zeroed(), if the pool is not
+// full. Called by scheduler() when it found nothing to run.
+void
+kzero_refill(void)
+{
+  struct run *r;
+
+  for(int i = 0; i < 8 && kzero.nfree < NZERO; i++){
+    if((r = kalloc()) == 0)
+      return;
+    memset((char*)r, 0, PGSIZE);
+    acquire(&kzero.lock);
+    putpages(&kzero, r, r, 1);
+    release(&kzero.lock);
+  }
+}
@@ -21,12 +21,16 @@ main()
     kvminithart();   // turn on paging
     procinit();      // process table
     trapinit();      // trap vectors
+    timersinit();    // sleep deadlines
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+#ifdef LAB_LOCK
+    statsinit();     // statistics device
+#endif
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
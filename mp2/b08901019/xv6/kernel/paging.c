@@ -5,6 +5,10 @@
 #include "spinlock.h"
 #include "defs.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "vm.h"
 
 /* NTU OS 2023 */
 /* Page fault handler */
@@ -17,36 +21,346 @@
 //   panic("not implemented yet\n");
 // }
 
+/* Swap-in readahead. */
+/* A fault on a swapped-out page also brings back up to */
+/* p->ra_win of the following pages, as long as they are */
+/* swapped out to consecutive slots, in one disk request. The */
+/* window doubles, up to ra.window, while faults keep */
+/* landing right after the previous readahead and most of it */
+/* was used, and halves otherwise. Prefetched pages are mapped */
+/* with PTE_A clear, so the next fault can tell which of them */
+/* have been touched since. */
+static struct {
+  int window;       /* max readahead window, tunable by swapra() */
+  uint64 faults;
+  uint64 pages;
+  uint64 hits;
+  uint64 misses;
+  uint64 evicted;   /* pages evicted by reclaim() */
+} ra = { SWAPRA };
+
+/* Count how much of the last readahead of p was used. */
+/* Returns nonzero if most of it was. */
+static int ra_account(struct proc *p) {
+  int hits = 0;
+
+  for (int i = 0; i < p->ra_len; i++) {
+    pte_t *pte = walk(p->pagetable, p->ra_start + i * PGSIZE, 0);
+    if (pte && (*pte & (PTE_V|PTE_A)) == (PTE_V|PTE_A))
+      hits++;
+  }
+  __sync_fetch_and_add(&ra.hits, hits);
+  __sync_fetch_and_add(&ra.misses, p->ra_len - hits);
+  return hits * 2 >= p->ra_len;
+}
+
+/* Bring back the swapped-out page at va, whose PTE is pte, */
+/* and whatever the readahead window says should follow it. */
+static int swapin(struct proc *p, uint64 va, pte_t *pte) {
+  struct pgreq r;
+  pte_t *ptes[NPGREQ];
+  uint64 blockNO = PTE2BLOCKNO(*pte);
+  int used, win, max;
+
+  __sync_fetch_and_add(&ra.faults, 1);
+
+  used = ra_account(p);
+  max = ra.window;
+  if (va == p->ra_next && used)
+    win = p->ra_win ? p->ra_win * 2 : 1;
+  else
+    win = p->ra_win / 2;
+  if (win > max) win = max;
+  p->ra_win = win;
+
+  if ((r.pages[0] = ukalloc()) == 0) return -1;
+  ptes[0] = pte;
+  r.npages = 1;
+  for (int i = 1; i <= win; i++) {
+    uint64 a = va + i * PGSIZE;
+    if (a >= p->sz) break;
+    pte_t *q = walk(p->pagetable, a, 0);
+    if (q == 0 || !(*q & PTE_S) || PTE2BLOCKNO(*q) != blockNO + i * BPP)
+      break;
+    if ((r.pages[i] = kalloc()) == 0) break;
+    ptes[i] = q;
+    r.npages++;
+  }
+
+  read_pages(&r, blockNO);
+
+  for (int i = 0; i < r.npages; i++) {
+    uint flags = (PTE_FLAGS(*ptes[i]) | PTE_V) & ~(PTE_S|PTE_A|PTE_D);
+    if (i == 0) flags |= PTE_A;
+    *ptes[i] = PA2PTE(r.pages[i]) | flags;
+    swapfree(blockNO + i * BPP);
+  }
+
+  __sync_fetch_and_add(&ra.pages, r.npages - 1);
+  p->ra_start = va + PGSIZE;
+  p->ra_len = r.npages - 1;
+  p->ra_next = va + r.npages * PGSIZE;
+  return 0;
+}
+
+/* Page replacement. */
+/* When memory runs out, ukalloc() evicts cold pages of the */
+/* current process with a clock (second chance) algorithm: */
+/* p->clock sweeps over p's user pages, clearing PTE_A on */
+/* pages used since the hand last passed and picking the ones */
+/* still clear. Copy-on-write pages still shared are left */
+/* alone, as evicting them would free nothing; once p holds */
+/* the last reference they are evicted as writable pages. */
+/* Only the current process is scanned, since no one else */
+/* changes its page table while it is in the kernel. */
+
+/* Evict up to n (at most NPGREQ) cold pages of p to swap. */
+/* Returns the number of pages evicted. */
+int reclaim(struct proc *p, int n) {
+  struct pgreq r;
+  pte_t *ptes[NPGREQ];
+  uint64 npages = PGROUNDUP(p->sz) / PGSIZE;
+
+  if (n > NPGREQ) n = NPGREQ;
+  if (p->clock >= p->sz) p->clock = 0;
+
+  /* Two turns of the hand at most: the first may only */
+  /* clear accessed bits. */
+  r.npages = 0;
+  for (uint64 i = 0; i < 2 * npages && r.npages < n; i++) {
+    uint64 va = p->clock;
+    p->clock = va + PGSIZE >= p->sz ? 0 : va + PGSIZE;
+
+    pte_t *pte = walksuper(p->pagetable, va);
+    if (pte) {
+      /* A superpage gets its second chance as a whole, and */
+      /* is split into ordinary pages if it is still cold. */
+      if (*pte & PTE_A) {
+        *pte &= ~PTE_A;
+        p->clock = SUPERPGROUNDDOWN(va) + SUPERPGSIZE;
+        if (p->clock >= p->sz) p->clock = 0;
+        continue;
+      }
+      demote(pte);
+    }
+    pte = walk(p->pagetable, va, 0);
+    if (pte == 0 || (*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U))
+      continue;
+    if (*pte & PTE_A) {
+      *pte &= ~PTE_A;
+      continue;
+    }
+    if (*pte & PTE_COW) {
+      if (krefcnt((void*)PTE2PA(*pte)) > 1)
+        continue;
+      *pte = (*pte & ~PTE_COW) | PTE_W;
+    }
+    ptes[r.npages] = pte;
+    r.pages[r.npages++] = (char*)PTE2PA(*pte);
+  }
+  sfence_vma();
+  if (r.npages == 0) return 0;
+
+  int got = swapout_start(&r, ptes);
+  if (got == 0) return 0;
+  pages_wait(&r);
+  for (int i = 0; i < got; i++)
+    kfree(r.pages[i]);
+  __sync_fetch_and_add(&ra.evicted, got);
+  return got;
+}
+
+/* kalloc() a page for user memory. If memory has run out, */
+/* evict some cold pages of the current process and retry. */
+void *ukalloc(void) {
+  struct proc *p = myproc();
+  void *mem;
+
+  while ((mem = kalloc()) == 0) {
+    if (p == 0 || reclaim(p, NPGREQ) == 0)
+      return 0;
+  }
+  return mem;
+}
+
+/* ukalloc() a zero-filled page. */
+void *ukalloc_zeroed(void) {
+  void *mem = kalloc_zeroed();
+
+  if (mem == 0 && (mem = ukalloc()) != 0)
+    memset(mem, 0, PGSIZE);
+  return mem;
+}
+
+/* Set the max swap-in readahead window to window pages, at */
+/* most NPGREQ - 1, unless it is negative, and copy the statistics to st */
+/* if it is not null. Returns the previous window. */
+int swapra(int window, struct swapra_stat *st) {
+  int old = ra.window;
+
+  if (window > NPGREQ - 1)
+    window = NPGREQ - 1;
+  if (window >= 0)
+    ra.window = window;
+  if (st) {
+    st->window = old;
+    st->faults = ra.faults;
+    st->pages = ra.pages;
+    st->hits = ra.hits;
+    st->misses = ra.misses;
+    st->evicted = ra.evicted;
+  }
+  return old;
+}
+
+static int faultaround(struct proc *p, uint64 page_addr);
+
 int handle_pgfault(struct proc* p, uint64 addr) {
 
   // mp2_5 !!!
 
+  if (addr >= MAXVA || walksuper(p->pagetable, addr))
+    return -1;  /* present superpage, so a protection fault */
+
   pte_t *currentp = walk(p->pagetable, addr, 0);
 
-  if (*currentp & PTE_S) {
-    uint64 blockNO = PTE2BLOCKNO(*currentp);
-    *currentp |= PTE_V;
-    *currentp &= ~PTE_S;
-    void* page = kalloc();
-    // Begin OP
-    begin_op();
-    read_page_from_disk(ROOTDEV, (char*)page, blockNO);
-    bfree_page(ROOTDEV,blockNO);
-    end_op();
-    // End OP
-    *currentp = PA2PTE(page) | PTE_FLAGS(*currentp);
-    return 0;
-  }
+  if (currentp && (*currentp & PTE_S))
+    return swapin(p, PGROUNDDOWN(addr), currentp);
+  if (currentp && (*currentp & PTE_V))
+    return -1;  /* present, so a protection fault */
 
   char *mem;
   if (addr >= p->sz) return -1;
+
+  /* Map a whole superpage if its 2 MiB lie inside p->sz and */
+  /* none of them has been touched yet. */
+  uint64 super_addr = SUPERPGROUNDDOWN(addr);
+  if (currentp == 0 && super_addr + SUPERPGSIZE <= p->sz &&
+      (mem = superalloc()) != 0) {
+    memset(mem, 0, SUPERPGSIZE);
+    if (mapsuper(p->pagetable, super_addr, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) == 0)
+      return 0;
+    superfree(mem);
+  }
+
   uint64 page_addr = PGROUNDDOWN(addr);
-  mem = kalloc();
+  mem = ukalloc_zeroed();
   if (mem == 0) return -1;
-  memset(mem, 0, PGSIZE);
   if(mappages(p->pagetable, page_addr, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
     kfree(mem);
     return -1;
   }
+  p->nlazy++;
+  p->nlazypages += 1 + faultaround(p, page_addr);
+  return 0;
+}
+
+/* Fault-around. */
+/* A lazy fault also maps the other untouched pages of the */
+/* aligned cluster of `cluster' pages around it, so a sweep */
+/* over a new heap takes one trap per cluster instead of one */
+/* per page. cluster is a power of two no larger than 512, */
+/* so a cluster never straddles a superpage. The extra pages */
+/* are only taken if memory is free; nothing is evicted for */
+/* them, and they are mapped with PTE_A clear so the */
+/* reclaimer takes them back first if they go unused. */
+static int cluster = FAULTAROUND;
+
+/* Map the untouched pages of page_addr's cluster. */
+/* Returns the number of pages mapped. */
+static int faultaround(struct proc *p, uint64 page_addr) {
+  uint64 start = page_addr & ~((uint64)cluster * PGSIZE - 1);
+  int n = 0;
+
+  for (uint64 va = start; va < start + cluster * PGSIZE && va < p->sz; va += PGSIZE) {
+    pte_t *pte = walk(p->pagetable, va, 0);
+    if (pte == 0 || (*pte & (PTE_V|PTE_S)))
+      continue;
+    char *mem = kalloc_zeroed();
+    if (mem == 0) break;
+    if (mappages(p->pagetable, va, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0) {
+      kfree(mem);
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+/* Set the fault-around cluster to n pages, rounded down to a */
+/* power of two and at most 512, unless n is not positive, */
+/* and copy p's page fault counters to st if it is not null. */
+/* Returns the previous cluster size. */
+int faultstat(struct proc *p, int n, struct faultstat *st) {
+  int old = cluster;
+
+  if (n > 512)
+    n = 512;
+  if (n > 0) {
+    int c = 1;
+    while (c * 2 <= n)
+      c *= 2;
+    cluster = c;
+  }
+  if (st) {
+    st->cluster = old;
+    st->faults = p->nfault;
+    st->lazy = p->nlazy;
+    st->pages = p->nlazypages;
+  }
+  return old;
+}
+
+/* Is va a present, user-accessible copy-on-write page? */
+int iscow(pagetable_t pagetable, uint64 va) {
+  if (va >= MAXVA) return 0;
+  pte_t *pte = walk(pagetable, va, 0);
+  if (pte == 0) return 0;
+  return (*pte & (PTE_V|PTE_U|PTE_COW)) == (PTE_V|PTE_U|PTE_COW);
+}
+
+/* Give the faulting process its own writable copy of a */
+/* copy-on-write page. If nobody else shares the page any */
+/* more, it is simply made writable again in place. Only */
+/* if reclaim is set may it evict pages, and so sleep, to */
+/* find memory for the copy. */
+int cowfault(pagetable_t pagetable, uint64 va, int reclaim) {
+  if (!iscow(pagetable, va)) return -1;
+
+  pte_t *pte = walk(pagetable, va, 0);
+  uint64 pa = PTE2PA(*pte);
+  uint flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+
+  if (krefcnt((void*)pa) == 1) {
+    *pte = PA2PTE(pa) | flags;
+    return 0;
+  }
+
+  char *mem = reclaim ? ukalloc() : kalloc();
+  if (mem == 0) return -1;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  kfree((void*)pa);
   return 0;
-}
\ No newline at end of file
+}
+
+/* Bring the pages of [va, va+len) of the current process in */
+/* as page faults would: swap them in, allocate lazy ones, */
+/* and, if write is set, break copy-on-write sharing. */
+/* copyin() and copyout() don't, as their callers may hold */
+/* spinlocks, so system calls do this first. Pages that */
+/* can't be brought in are left for the copy to fail on. */
+void prefault(uint64 va, uint64 len, int write) {
+  struct proc *p = myproc();
+  uint64 end = va + len;
+
+  if (end < va || end > p->sz) end = p->sz;
+  for (uint64 a = PGROUNDDOWN(va); a < end; a += PGSIZE) {
+    if (walksuper(p->pagetable, a)) continue;
+    pte_t *pte = walk(p->pagetable, a, 0);
+    if (pte == 0 || (*pte & PTE_V) == 0)
+      handle_pgfault(p, a);
+    else if (write && iscow(p->pagetable, a))
+      cowfault(p->pagetable, a, 1);
+  }
+}
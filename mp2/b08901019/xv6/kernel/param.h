@@ -10,4 +10,12 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define SWAPSIZE     262144 // size of swap area in blocks, after the file system
 #define MAXPATH      128   // maximum file path name
+#define NPGREQ       16    // max pages in one multi-page disk request
+#define SWAPRA       8     // default max swap-in readahead window, in pages
+#define FAULTAROUND  8     // default pages mapped per lazy page fault
+#define NMLFQ        3     // scheduler priority levels
+#define BOOSTTICKS   10    // ticks between priority boosts
+#define TIMEBASE     10000000 // rate of the time CSR, in cycles per second (qemu)
+#define TICKCYCLES   (TIMEBASE/10) // length of a scheduler tick, in cycles
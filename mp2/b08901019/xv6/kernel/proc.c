@@ -17,6 +17,8 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void runnable(struct proc *p);
+static int toplevel(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,6 +28,25 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// Per-CPU run queues.
+//
+// A RUNNABLE process is on exactly one CPU's run queue, in a
+// FIFO list per MLFQ level. A process that uses up the
+// quantum of its level (1 << level ticks) moves down a level;
+// one that sleeps first keeps it. Every BOOSTTICKS ticks all
+// processes go back up to the highest level their nice value
+// allows, so none starves. A CPU with nothing queued steals
+// from the others before it waits for an interrupt.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NMLFQ];
+  struct proc *tail[NMLFQ];
+  int n;                       // processes queued
+};
+
+struct runq runq[NCPU];
+static int boosts;             // times mlfq_boost() ran
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -50,6 +71,8 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
@@ -119,6 +142,17 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  push_off();
+  p->cpu = cpuid();
+  pop_off();
+  p->level = 0;
+  p->nice = 0;
+  p->used = 0;
+  p->boost = boosts;
+  p->nsched = 0;
+  p->waitsum = 0;
+  p->waitmax = 0;
+  p->theap = -1;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -163,6 +197,14 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->ra_next = 0;
+  p->ra_start = 0;
+  p->ra_len = 0;
+  p->ra_win = 0;
+  p->clock = 0;
+  p->nfault = 0;
+  p->nlazy = 0;
+  p->nlazypages = 0;
   p->state = UNUSED;
 }
 
@@ -242,7 +284,7 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  runnable(p);
 
   release(&p->lock);
 }
@@ -302,6 +344,8 @@ fork(void)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->nice = p->nice;
+  np->level = toplevel(np);
 
   pid = np->pid;
 
@@ -312,7 +356,7 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  runnable(np);
   release(&np->lock);
 
   return pid;
@@ -387,6 +431,9 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the status is copied out under np->lock.
+  if(addr != 0)
+    prefault(addr, sizeof(int), 1);
   acquire(&wait_lock);
 
   for(;;){
@@ -427,10 +474,165 @@ wait(uint64 addr)
   }
 }
 
+// Highest MLFQ level p may run at: nice values above 0
+// keep a process off the top levels.
+static int
+toplevel(struct proc *p)
+{
+  return p->nice * NMLFQ / 20;
+}
+
+// Make p RUNNABLE and put it at the end of its level on the
+// run queue of p->cpu. Caller must hold p->lock.
+static void
+runnable(struct proc *p)
+{
+  struct runq *rq = &runq[p->cpu];
+
+  if(p->boost != boosts){
+    p->boost = boosts;
+    p->level = toplevel(p);
+    p->used = 0;
+  }
+  p->state = RUNNABLE;
+  p->readyat = r_time();
+  p->rqnext = 0;
+
+  acquire(&rq->lock);
+  if(rq->tail[p->level])
+    rq->tail[p->level]->rqnext = p;
+  else
+    rq->head[p->level] = p;
+  rq->tail[p->level] = p;
+  rq->n++;
+  release(&rq->lock);
+
+  // idle harts take no timer ticks, so wake one up: the
+  // owner of the queue, or else one that can steal from it.
+  if(cpus[p->cpu].idle){
+    timer_kick(p->cpu);
+    return;
+  }
+  for(int i = 0; i < NCPU; i++){
+    if(cpus[i].idle){
+      timer_kick(i);
+      return;
+    }
+  }
+}
+
+// Take the first process of the highest non-empty level of
+// rq off it, setting *level to that level. Returns 0 if rq
+// is empty.
+static struct proc*
+dequeue(struct runq *rq, int *level)
+{
+  struct proc *p = 0;
+
+  if(rq->n == 0)
+    return 0;
+  acquire(&rq->lock);
+  for(int l = 0; l < NMLFQ; l++){
+    if((p = rq->head[l]) != 0){
+      if((rq->head[l] = p->rqnext) == 0)
+        rq->tail[l] = 0;
+      rq->n--;
+      *level = l;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Is anything waiting on any run queue?
+static int
+queued(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    if(runq[i].n)
+      return 1;
+  return 0;
+}
+
+// Put every queued process back at the top level.
+// Called by clockintr() every BOOSTTICKS ticks; the others
+// get their level back the next time they become RUNNABLE.
+void
+mlfq_boost(void)
+{
+  struct runq *rq;
+
+  boosts++;
+  for(rq = runq; rq < &runq[NCPU]; rq++){
+    if(rq->n == 0)
+      continue;
+    acquire(&rq->lock);
+    for(int l = 1; l < NMLFQ; l++){
+      if(rq->head[l] == 0)
+        continue;
+      if(rq->tail[0])
+        rq->tail[0]->rqnext = rq->head[l];
+      else
+        rq->head[0] = rq->head[l];
+      rq->tail[0] = rq->tail[l];
+      rq->head[l] = rq->tail[l] = 0;
+    }
+    release(&rq->lock);
+  }
+}
+
+// Charge the running process for a timer tick. Returns 1 if
+// it should yield: it used up its quantum, which moves it
+// down a level, or a process of a higher level is waiting.
+int
+schedtick(void)
+{
+  struct proc *p = myproc();
+  struct runq *rq;
+  int expired;
+
+  acquire(&p->lock);
+  expired = ++p->used >= (1 << p->level);
+  if(expired){
+    p->used = 0;
+    if(p->level < NMLFQ-1)
+      p->level++;
+  }
+  rq = &runq[p->cpu];
+  for(int l = 0; l < p->level && !expired; l++)
+    expired = rq->head[l] != 0;
+  release(&p->lock);
+
+  // no point in yielding if nothing else could run.
+  if(expired && !queued())
+    expired = 0;
+  return expired;
+}
+
+// Add n to the nice value of p, keeping it within 0..19.
+// Returns the new nice value.
+int
+setnice(struct proc *p, int n)
+{
+  acquire(&p->lock);
+  p->nice += n;
+  if(p->nice < 0)
+    p->nice = 0;
+  if(p->nice > 19)
+    p->nice = 19;
+  if(p->level < toplevel(p))
+    p->level = toplevel(p);
+  n = p->nice;
+  release(&p->lock);
+  return n;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run, from this CPU's run queue
+//    or else from another CPU's.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -439,28 +641,65 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid(), level;
+  uint64 wait;
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+    p = dequeue(&runq[id], &level);
+    for(int i = 1; p == 0 && i < NCPU; i++)
+      p = dequeue(&runq[(id + i) % NCPU], &level);
+    if(p == 0){
+      // nothing to run; get some pages ready for page faults,
+      // then wait for an interrupt with no tick armed. Look
+      // at the queues once more after saying we are idle, since
+      // runnable() only kicks harts it sees idle.
+      kzero_refill();
+      c->idle = 1;
+      timer_arm();
+      __sync_synchronize();
+      if(!queued())
+        asm volatile("wfi");
+      c->idle = 0;
+      continue;
+    }
+
+    // charge it a tick TICKCYCLES from now.
+    c->nexttick = r_time() + TICKCYCLES;
+    timer_arm();
+
+    // p is off the queues, so it is ours. Its lock is still
+    // held if it is on its way out of another CPU.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    if(p->boost != boosts){
+      p->boost = boosts;
+      p->used = 0;
     }
+    p->level = level < toplevel(p) ? toplevel(p) : level;
+    p->cpu = id;
+    wait = r_time() - p->readyat;
+    p->nsched++;
+    p->waitsum += wait;
+    if(wait > p->waitmax)
+      p->waitmax = wait;
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    c->proc = p;
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    c->nexttick = 0;
+    release(&p->lock);
   }
 }
 
@@ -497,7 +736,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  runnable(p);
   sched();
   release(&p->lock);
 }
@@ -565,7 +804,7 @@ wakeup(void *chan)
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        runnable(p);
       }
       release(&p->lock);
     }
@@ -586,7 +825,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        runnable(p);
       }
       release(&p->lock);
       return 0;
@@ -634,6 +873,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
@@ -651,6 +891,10 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    // scheduling latency: time from RUNNABLE to RUNNING, in us.
+    printf(" level %d nice %d sched %d wait avg %d max %d us", p->level, p->nice,
+           (int)p->nsched, p->nsched ? (int)(p->waitsum / p->nsched / (TIMEBASE/1000000)) : 0,
+           (int)(p->waitmax / (TIMEBASE/1000000)));
     printf("\n");
   }
 }
@@ -24,6 +24,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // Waiting in wfi for something to run?
+  uint64 nexttick;            // When c->proc is next charged a tick, or 0.
 };
 
 extern struct cpu cpus[NCPU];
@@ -105,4 +107,32 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+
+  // swap-in readahead state, see handle_pgfault().
+  uint64 ra_next;              // va a sequential swap-in fault would hit
+  uint64 ra_start;             // first page prefetched last time
+  int ra_len;                  // number of pages prefetched last time
+  int ra_win;                  // current readahead window, in pages
+  uint64 clock;                // page reclaimer's clock hand
+
+  // page fault counters, see faultstat().
+  uint64 nfault;               // page faults taken
+  uint64 nlazy;                // faults on not yet allocated heap
+  uint64 nlazypages;           // pages mapped by those
+
+  // scheduling state, see scheduler(). p->lock must be held.
+  struct proc *rqnext;         // next on its run queue
+  int cpu;                     // CPU whose run queue it goes on
+  int level;                   // MLFQ level, 0 runs first
+  int nice;                    // 0..19, higher may not use the top levels
+  int used;                    // ticks used at this level
+  int boost;                   // priority boosts seen
+  uint64 readyat;              // time it last became RUNNABLE
+  uint64 nsched;               // times it was picked to run
+  uint64 waitsum;              // total time spent RUNNABLE, in cycles
+  uint64 waitmax;              // longest such wait
+
+  // timer state, see tsleep(). timers.lock must be held.
+  uint64 wakeat;               // deadline of the current tsleep()
+  int theap;                   // index in the timer heap, or -1
 };
@@ -14,6 +14,7 @@ fetchaddr(uint64 addr, uint64 *ip)
   struct proc *p = myproc();
   if(addr >= p->sz || addr+sizeof(uint64) > p->sz)
     return -1;
+  prefault(addr, sizeof(*ip), 0);
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
   return 0;
@@ -25,6 +26,7 @@ int
 fetchstr(uint64 addr, char *buf, int max)
 {
   struct proc *p = myproc();
+  prefault(addr, max, 0);
   int err = copyinstr(p->pagetable, buf, addr, max);
   if(err < 0)
     return err;
@@ -114,6 +116,10 @@ extern uint64 sys_pgaccess(void);
 /* Syscalls for MP2 */
 extern uint64 sys_vmprint(void);
 extern uint64 sys_madvise(void);
+extern uint64 sys_swapra(void);
+extern uint64 sys_faultstat(void);
+extern uint64 sys_nice(void);
+extern uint64 sys_nanosleep(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -147,6 +153,10 @@ static uint64 (*syscalls[])(void) = {
 /* Syscalls for MP2 */
 [SYS_vmprint]   sys_vmprint,
 [SYS_madvise]   sys_madvise,
+[SYS_swapra]    sys_swapra,
+[SYS_faultstat] sys_faultstat,
+[SYS_nice]      sys_nice,
+[SYS_nanosleep] sys_nanosleep,
 };
 
 
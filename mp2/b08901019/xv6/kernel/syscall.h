@@ -33,3 +33,7 @@
 #define SYS_pgaccess  30
 #define SYS_vmprint  31
 #define SYS_madvise  32
+#define SYS_swapra   33
+#define SYS_faultstat 34
+#define SYS_nice     35
+#define SYS_nanosleep 36
@@ -474,6 +474,7 @@ sys_pipe(void)
     fileclose(wf);
     return -1;
   }
+  prefault(fdarray, 2*sizeof(fd0), 1);
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
     p->ofile[fd0] = 0;
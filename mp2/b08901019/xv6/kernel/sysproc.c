@@ -64,22 +64,27 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
-
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return myproc()->killed ? -1 : 0;
+  return tsleep(r_time() + (uint64)n * TICKCYCLES);
+}
+
+// sleep for the given number of nanoseconds, rounded up
+// to the resolution of the time CSR.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns, cycles;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  cycles = (ns + (1000000000/TIMEBASE) - 1) / (1000000000/TIMEBASE);
+  if(cycles == 0)
+    return myproc()->killed ? -1 : 0;
+  return tsleep(r_time() + cycles);
 }
 
 
@@ -102,15 +107,21 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
-// since start.
+// return how many clock ticks have passed since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return r_time() / TICKCYCLES;
+}
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+// add the argument to the nice value of the calling
+// process; returns the new value.
+uint64
+sys_nice(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return setnice(myproc(), n);
 }
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "defs.h"
 #include "proc.h"
+#include "vm.h"
 
 /* NTU OS 2022 */
 /* Entry of vmprint() syscall. */
@@ -33,3 +34,40 @@ sys_madvise(void)
   int ret = madvise(addr, length, advise);
   return ret;
 }
+
+/* Entry of swapra() syscall. */
+uint64
+sys_swapra(void)
+{
+  int window;
+  uint64 addr;
+  struct swapra_stat st;
+
+  if (argint(0, &window) < 0) return -1;
+  if (argaddr(1, &addr) < 0) return -1;
+
+  int old = swapra(window, &st);
+  if (addr != 0) prefault(addr, sizeof(st), 1);
+  if (addr != 0 && copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return old;
+}
+
+/* Entry of faultstat() syscall. */
+uint64
+sys_faultstat(void)
+{
+  int cluster;
+  uint64 addr;
+  struct faultstat st;
+  struct proc *p = myproc();
+
+  if (argint(0, &cluster) < 0) return -1;
+  if (argaddr(1, &addr) < 0) return -1;
+
+  int old = faultstat(p, cluster, &st);
+  if (addr != 0) prefault(addr, sizeof(st), 1);
+  if (addr != 0 && copyout(p->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return old;
+}
@@ -0,0 +1,173 @@
+// Timers.
+//
+// There is no periodic clock interrupt. Each hart programs its
+// CLINT comparator for the next event it cares about: the
+// earliest deadline of a sleeping process and, while it runs
+// a process, that process's next scheduler tick. A hart with
+// nothing to run waits in wfi with only the deadline armed.
+//
+// timervec in kernelvec.S disarms the comparator when it
+// fires; timerintr() handles the event and rearms it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NEVER (~0ULL)
+
+// Sleeping processes, in a min-heap ordered by p->wakeat.
+// p->theap is each one's index, or -1.
+struct {
+  struct spinlock lock;
+  struct proc *heap[NPROC];
+  int n;
+} timers;
+
+void
+timersinit(void)
+{
+  initlock(&timers.lock, "timers");
+}
+
+static void
+tswap(int i, int j)
+{
+  struct proc *t = timers.heap[i];
+
+  timers.heap[i] = timers.heap[j];
+  timers.heap[j] = t;
+  timers.heap[i]->theap = i;
+  timers.heap[j]->theap = j;
+}
+
+static void
+tup(int i)
+{
+  while(i > 0 && timers.heap[i]->wakeat < timers.heap[(i-1)/2]->wakeat){
+    tswap(i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void
+tdown(int i)
+{
+  int c;
+
+  for(;;){
+    c = 2*i + 1;
+    if(c >= timers.n)
+      return;
+    if(c+1 < timers.n && timers.heap[c+1]->wakeat < timers.heap[c]->wakeat)
+      c++;
+    if(timers.heap[i]->wakeat <= timers.heap[c]->wakeat)
+      return;
+    tswap(i, c);
+    i = c;
+  }
+}
+
+// Take p off the heap. Caller must hold timers.lock.
+static void
+tdel(struct proc *p)
+{
+  int i = p->theap;
+
+  p->theap = -1;
+  if(--timers.n == i)
+    return;
+  timers.heap[i] = timers.heap[timers.n];
+  timers.heap[i]->theap = i;
+  tup(i);
+  tdown(i);
+}
+
+// Program this hart's comparator. Caller must hold
+// timers.lock with interrupts off.
+static void
+tarm(void)
+{
+  struct cpu *c = mycpu();
+  uint64 next;
+
+  next = c->nexttick ? c->nexttick : NEVER;
+  if(timers.n > 0 && timers.heap[0]->wakeat < next)
+    next = timers.heap[0]->wakeat;
+  *(uint64*)CLINT_MTIMECMP(cpuid()) = next;
+}
+
+void
+timer_arm(void)
+{
+  acquire(&timers.lock);
+  tarm();
+  release(&timers.lock);
+}
+
+// Make an idle hart take a timer interrupt now, so that it
+// looks at the run queues again.
+void
+timer_kick(int id)
+{
+  *(uint64*)CLINT_MTIMECMP(id) = 0;
+}
+
+// Sleep until the time CSR reaches deadline.
+// Returns -1 if killed first.
+int
+tsleep(uint64 deadline)
+{
+  struct proc *p = myproc();
+
+  acquire(&timers.lock);
+  p->wakeat = deadline;
+  p->theap = timers.n++;
+  timers.heap[p->theap] = p;
+  tup(p->theap);
+  while(r_time() < deadline){
+    if(p->killed){
+      tdel(p);
+      release(&timers.lock);
+      return -1;
+    }
+    // the scheduler arms the comparator before it
+    // runs anything else on this hart.
+    sleep(&p->wakeat, &timers.lock);
+  }
+  if(p->theap >= 0)
+    tdel(p);
+  release(&timers.lock);
+  return 0;
+}
+
+// Handle a timer interrupt: wake the sleepers whose deadlines
+// have passed and rearm. Returns 1 if the running process is
+// due for a scheduler tick.
+int
+timerintr(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now = r_time();
+  struct proc *p;
+  int tick = 0;
+
+  clockintr();
+
+  acquire(&timers.lock);
+  while(timers.n > 0 && timers.heap[0]->wakeat <= now){
+    p = timers.heap[0];
+    tdel(p);
+    wakeup(&p->wakeat);
+  }
+  if(c->nexttick && now >= c->nexttick){
+    c->nexttick = now + TICKCYCLES;
+    tick = 1;
+  }
+  tarm();
+  release(&timers.lock);
+  return tick;
+}
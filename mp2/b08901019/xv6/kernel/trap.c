@@ -69,9 +69,16 @@ usertrap(void)
     // ok
   } else if(r_scause() == 13 || r_scause() == 15){
     /* NTU OS 2023*/
-    // if (handle_pgfault(p, r_stval()) == -1) p->killed = 1;
     uint64 va = r_stval();
-    handle_pgfault(p, va);
+    p->nfault++;
+    if(r_scause() == 15 && iscow(p->pagetable, va)){
+      // write to a page shared copy-on-write by fork().
+      if(cowfault(p->pagetable, va, 1) < 0)
+        p->killed = 1;
+    } else if(handle_pgfault(p, va) < 0){
+      // bad address, or out of both memory and swap.
+      p->killed = 1;
+    }
 
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
@@ -82,8 +89,9 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt
+  // and the process used up its quantum.
+  if(which_dev == 2 && schedtick())
     yield();
 
   usertrapret();
@@ -155,8 +163,9 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // give up the CPU if this is a timer interrupt
+  // and the process used up its quantum.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && schedtick())
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -165,19 +174,26 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// bring ticks up to date with the time CSR; called by
+// timerintr() on whichever hart took the interrupt.
 void
 clockintr()
 {
+  uint now = r_time() / TICKCYCLES;
+  int boost;
+
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  boost = now / BOOSTTICKS != ticks / BOOSTTICKS;
+  ticks = now;
   release(&tickslock);
+  if(boost)
+    mlfq_boost();
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
-// 1 if other device,
+// returns 2 if the running process is due for a tick,
+// 1 if other device or timer event,
 // 0 if not recognized.
 int
 devintr()
@@ -210,15 +226,11 @@ devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    return timerintr() ? 2 : 1;
   } else {
     return 0;
   }
@@ -45,7 +45,9 @@
 
 // this many virtio descriptors.
 // must be a power of two.
-#define NUM 8
+// a multi-page request needs npages+2 of them, and
+// madv_dontneed() keeps two of NPGREQ pages in flight.
+#define NUM 64
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -62,6 +62,7 @@ static struct disk {
   // indexed by first descriptor index of chain.
   struct {
     struct buf *b;
+    struct pgreq *r;
     char status;
   } info[NUM];
 
@@ -126,7 +127,7 @@ virtio_disk_init(void)
   *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
 
   // desc = pages -- num * virtq_desc
-  // avail = pages + 0x40 -- 2 * uint16, then num * uint16
+  // avail = pages + num * 16 -- 2 * uint16, then num * uint16
   // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
   disk.desc = (struct virtq_desc *) disk.pages;
@@ -184,12 +185,12 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
+// single-block transfers use three descriptors.
 static int
-alloc3_desc(int *idx)
+allocn_desc(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -214,7 +215,7 @@ virtio_disk_rw(struct buf *b, int write)
   // allocate the three descriptors.
   int idx[3];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(allocn_desc(idx, 3) == 0) {
       break;
     }
     sleep(&disk.free[0], &disk.vdisk_lock);
@@ -279,6 +280,98 @@ virtio_disk_rw(struct buf *b, int write)
   release(&disk.vdisk_lock);
 }
 
+// Start reading or writing r->npages whole pages at
+// consecutive sectors starting at r->sector, as one
+// request of r->npages+2 descriptors. Does not wait for
+// the disk; the caller must keep r and its pages alive
+// until virtio_disk_wait_pages(r) returns.
+void
+virtio_disk_submit_pages(struct pgreq *r, int write)
+{
+  int idx[NPGREQ+2];
+  int n = r->npages + 2;
+
+  if(r->npages < 1 || r->npages > NPGREQ)
+    panic("virtio_disk_submit_pages");
+
+  acquire(&disk.vdisk_lock);
+
+  while(1){
+    if(allocn_desc(idx, n) == 0) {
+      break;
+    }
+    sleep(&disk.free[0], &disk.vdisk_lock);
+  }
+
+  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+
+  if(write)
+    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
+  else
+    buf0->type = VIRTIO_BLK_T_IN; // read the disk
+  buf0->reserved = 0;
+  buf0->sector = r->sector;
+
+  disk.desc[idx[0]].addr = (uint64) buf0;
+  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
+  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  disk.desc[idx[0]].next = idx[1];
+
+  // one data descriptor per page, since the pages
+  // need not be physically contiguous.
+  for(int i = 0; i < r->npages; i++){
+    disk.desc[idx[i+1]].addr = (uint64) r->pages[i];
+    disk.desc[idx[i+1]].len = PGSIZE;
+    if(write)
+      disk.desc[idx[i+1]].flags = 0; // device reads the page
+    else
+      disk.desc[idx[i+1]].flags = VRING_DESC_F_WRITE; // device writes the page
+    disk.desc[idx[i+1]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i+1]].next = idx[i+2];
+  }
+
+  disk.info[idx[0]].status = 0xff; // device writes 0 on success
+  disk.desc[idx[n-1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n-1]].len = 1;
+  disk.desc[idx[n-1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n-1]].next = 0;
+
+  // record the request for virtio_disk_intr().
+  r->disk = 1;
+  r->idx = idx[0];
+  disk.info[idx[0]].r = r;
+
+  // tell the device the first index in our chain of descriptors.
+  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+
+  __sync_synchronize();
+
+  // tell the device another avail ring entry is available.
+  disk.avail->idx += 1; // not % NUM ...
+
+  __sync_synchronize();
+
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+
+  release(&disk.vdisk_lock);
+}
+
+// Wait for a request started by virtio_disk_submit_pages().
+void
+virtio_disk_wait_pages(struct pgreq *r)
+{
+  acquire(&disk.vdisk_lock);
+
+  while(r->disk == 1) {
+    sleep(r, &disk.vdisk_lock);
+  }
+
+  disk.info[r->idx].r = 0;
+  free_chain(r->idx);
+
+  release(&disk.vdisk_lock);
+}
+
 void
 virtio_disk_intr()
 {
@@ -304,9 +397,15 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    if(disk.info[id].r){
+      struct pgreq *r = disk.info[id].r;
+      r->disk = 0;   // disk is done with the pages
+      wakeup(r);
+    } else {
+      struct buf *b = disk.info[id].b;
+      b->disk = 0;   // disk is done with buf
+      wakeup(b);
+    }
 
     disk.used_idx += 1;
   }
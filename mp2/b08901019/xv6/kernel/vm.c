@@ -6,6 +6,8 @@
 #include "defs.h"
 #include "fs.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "buf.h"
 #include "proc.h"
 #include "vm.h"
 
@@ -33,6 +35,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, so that each hart can program its own timer
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -80,6 +85,10 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// va must not be inside a superpage (a level-1 leaf); if it is,
+// walk() returns 0, or panics when asked to allocate. See
+// walksuper() for those.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
@@ -89,17 +98,82 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte)){
+        if(alloc)
+          panic("walk: superpage");
+        return 0;
+      }
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
   return &pagetable[PX(0, va)];
 }
 
+// Return the address of the level-1 PTE that maps the 2 MiB
+// superpage containing va, or 0 if va is not in a superpage.
+pte_t *
+walksuper(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    return 0;
+  pte = &pagetable[PX(2, va)];
+  if((*pte & PTE_V) == 0)
+    return 0;
+  pte = &((pagetable_t)PTE2PA(*pte))[PX(1, va)];
+  if((*pte & PTE_V) && PTE_LEAF(*pte))
+    return pte;
+  return 0;
+}
+
+// Map the superpage at physical address pa at va, both
+// superpage-aligned. No page of [va, va+SUPERPGSIZE) may be
+// mapped yet. Returns 0 on success, -1 if a page-table page
+// couldn't be allocated.
+int
+mapsuper(pagetable_t pagetable, uint64 va, uint64 pa, int perm)
+{
+  pte_t *pte;
+  pagetable_t l1;
+
+  if((va % SUPERPGSIZE) != 0 || (pa % SUPERPGSIZE) != 0)
+    panic("mapsuper: not aligned");
+
+  pte = &pagetable[PX(2, va)];
+  if(*pte & PTE_V){
+    l1 = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if((l1 = (pagetable_t)kalloc_zeroed()) == 0)
+      return -1;
+    *pte = PA2PTE(l1) | PTE_V;
+  }
+  pte = &l1[PX(1, va)];
+  if(*pte & PTE_V)
+    panic("mapsuper: remap");
+  *pte = PA2PTE(pa) | perm | PTE_V;
+  return 0;
+}
+
+// Replace the superpage mapped by the level-1 PTE *pte with
+// 512 ordinary mappings of the same memory and permissions,
+// in the page-table page reserved for it by superalloc().
+void
+demote(pte_t *pte)
+{
+  uint64 pa = PTE2PA(*pte);
+  uint flags = PTE_FLAGS(*pte);
+  pagetable_t pt = ksplit((void*)pa);
+
+  for(int i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(pt) | PTE_V;
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -112,9 +186,16 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if(va >= MAXVA)
     return 0;
 
+  if((pte = walksuper(pagetable, va)) != 0){
+    if((*pte & PTE_U) == 0)
+      return 0;
+    return PTE2PA(*pte) + (va & (SUPERPGSIZE-1));
+  }
   pte = walk(pagetable, va, 0);
   if(pte == 0)
     return 0;
+  // a swapped-out page is not brought back here, since callers
+  // may hold spinlocks; system calls prefault() user buffers.
   if((*pte & PTE_V) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
@@ -165,6 +246,7 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 // Remove npages of mappings starting from va. va must be
 // page-aligned. The mappings must exist.
 // Optionally free the physical memory.
+// A superpage only partly in the range is split up first.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
@@ -177,9 +259,27 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
     /* NTU OS 2023*/
 
+    if((pte = walksuper(pagetable, a)) != 0){
+      if((a % SUPERPGSIZE) == 0 && a + SUPERPGSIZE <= va + npages*PGSIZE){
+        if(do_free)
+          superfree((void*)PTE2PA(*pte));
+        *pte = 0;
+        a += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      demote(pte);
+    }
+
     if((pte = walk(pagetable, a, 0)) == 0)
       // panic("uvmunmap: walk");
       continue;
+    if(*pte & PTE_S){
+      // swapped out: release its swap slot instead.
+      if(do_free)
+        swapfree(PTE2BLOCKNO(*pte));
+      *pte = 0;
+      continue;
+    }
     if((*pte & PTE_V) == 0)
       // panic("uvmunmap: not mapped");
       continue;
@@ -199,10 +299,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -235,12 +334,23 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    // use a superpage where a whole, untouched one fits.
+    if((a % SUPERPGSIZE) == 0 && a + SUPERPGSIZE <= newsz &&
+       walk(pagetable, a, 0) == 0 && (mem = superalloc()) != 0){
+      memset(mem, 0, SUPERPGSIZE);
+      if(mapsuper(pagetable, a, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+        superfree(mem);
+        uvmdealloc(pagetable, a, oldsz);
+        return 0;
+      }
+      a += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    mem = ukalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -298,10 +408,15 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share
+// its memory with a child's page table.
+// Writable pages are mapped read-only and marked
+// PTE_COW in both page tables; the first write by
+// either process copies the page (see cowfault()).
+// Swapped-out pages are read back into a private
+// copy for the child; lazily allocated pages that
+// were never touched are left unmapped. Superpages
+// are split into ordinary pages first.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -313,19 +428,32 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
+    if((pte = walksuper(old, i)) != 0){
+      // split it up and share it page by page.
+      demote(pte);
+    }
     if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+      continue;
+    if(*pte & PTE_S){
+      flags = (PTE_FLAGS(*pte) & ~PTE_S) | PTE_V;
+      if((mem = ukalloc()) == 0)
+        goto err;
+      read_page_from_disk(ROOTDEV, mem, PTE2BLOCKNO(*pte));
+      if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
+        kfree(mem);
+        goto err;
+      }
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
-    }
+    kaddref((void*)pa);
   }
   return 0;
 
@@ -357,6 +485,8 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
+    if(iscow(pagetable, va0) && cowfault(pagetable, va0, 0) < 0)
+      return -1;
     pa0 = walkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
@@ -493,7 +623,7 @@ void vmprint_recur(pagetable_t pagetable, int position, int conti_type, int Base
         printf("%s%s%d: pte=%p va=%p blockno=%p%s%s%s%s%s%s\n", conti_icon, "+-- ", i, (uint64)pagetable + (uint64)(i*8), VA, blockno, vv, rr, ww, xx, uu, ss);
       }
       
-      if (position != 3){
+      if (position != 3 && !PTE_LEAF(current_pte)){
         uint64 sub_tree = PTE2PA(current_pte);
         int next_position = 0;
         if (position == 1) next_position = 2;
@@ -546,28 +676,87 @@ int madv_normal(uint64 base, uint64 length) {
   if ( base < 0  || base < myproc()->trapframe->sp || length < 0 || target > myproc()->sz ) return -1;
   return 0;
 }
+/* Swap out the present pages in [base, base+length). Runs of */
+/* up to NPGREQ consecutive pages are given consecutive swap */
+/* slots and written with one disk request, and the next run */
+/* is submitted while the previous one is still being written; */
+/* NUM in virtio.h leaves descriptors for two runs. */
 int madv_dontneed(uint64 base, uint64 length) {
   if (madv_normal(base, length) == -1) return -1;
-  uint64 target = base + length;
-  for (uint64 i = PGROUNDDOWN(base); i < PGROUNDUP(target); i += 8*512){
-    struct proc *p = myproc();
-    pte_t *currentp = walk(p->pagetable, i, 0);
-
-    if (*currentp & PTE_V){
-      *currentp |= PTE_S;
-      *currentp &= ~PTE_V;
-      // Begin OP
-      begin_op();
-      uint blockNO = balloc_page(ROOTDEV);
-      write_page_to_disk(ROOTDEV, (char*)PTE2PA(*currentp), blockNO);
-      end_op();
-      // End OP
-      kfree( (void*) ( PTE2PA(*currentp) ) );
-      *currentp = BLOCKNO2PTE(blockNO) | PTE_FLAGS(*currentp);
+  struct proc *p = myproc();
+  uint64 target = PGROUNDUP(base + length);
+  struct pgreq req[2];
+  pte_t *ptes[2][NPGREQ];
+  int cur = 0, inflight = 0, full = 0;
+
+  uint64 va = PGROUNDDOWN(base);
+  for (;;) {
+    struct pgreq *r = &req[cur];
+
+    // Gather a run of consecutive present pages.
+    r->npages = 0;
+    for (; va < target && r->npages < NPGREQ; va += PGSIZE) {
+      pte_t *spte = walksuper(p->pagetable, va);
+      if (spte) {
+        // only ordinary pages can be swapped; split it up.
+        demote(spte);
+      }
+      pte_t *pte = walk(p->pagetable, va, 0);
+      if (pte == 0 || (*pte & PTE_V) == 0) {
+        if (r->npages > 0) break;
+        continue;
+      }
+      ptes[cur][r->npages] = pte;
+      r->pages[r->npages++] = (char*)PTE2PA(*pte);
     }
+    if (r->npages == 0) break;
+
+    int want = r->npages;
+    int got = swapout_start(r, ptes[cur]);
+    if (got == 0) {
+      full = 1;
+      break;
+    }
+    // Only a shorter run of slots was free; retry the rest.
+    va -= (want - got) * PGSIZE;
+
+    if (inflight) {
+      pages_wait(&req[cur^1]);
+      for (int i = 0; i < req[cur^1].npages; i++)
+        kfree(req[cur^1].pages[i]);
+    }
+    inflight = 1;
+    cur ^= 1;
   }
-  return 0;
+
+  if (inflight) {
+    pages_wait(&req[cur^1]);
+    for (int i = 0; i < req[cur^1].npages; i++)
+      kfree(req[cur^1].pages[i]);
+  }
+  return full ? -1 : 0;
 }
+
+/* Give the r->npages pages in r->pages, mapped by the PTEs */
+/* in ptes, consecutive swap slots, mark the PTEs swapped out */
+/* and start writing the pages as one disk request. If only a */
+/* shorter run of slots is free, only that many pages are */
+/* taken. Returns the number of pages taken, 0 if swap is */
+/* full. The pages may be kfree()d once pages_wait(r) returns. */
+int swapout_start(struct pgreq *r, pte_t **ptes) {
+  int got;
+  uint blockNO = swapalloc(r->npages, &got);
+  if (got == 0) return 0;
+
+  r->npages = got;
+  for (int i = 0; i < r->npages; i++) {
+    pte_t *pte = ptes[i];
+    *pte = BLOCKNO2PTE(blockNO + i*BPP) | ((PTE_FLAGS(*pte) | PTE_S) & ~PTE_V);
+  }
+  write_pages_start(r, blockNO);
+  return got;
+}
+
 int madv_willneed(uint64 base, uint64 length) {
   if (madv_normal(base,length) == -1) return -1;
   uint64 target = base + length;
@@ -575,21 +764,18 @@ int madv_willneed(uint64 base, uint64 length) {
     struct proc *p = myproc();
     pte_t *currentp = walk(p->pagetable,i,0);
 
-    if ( !(*currentp & PTE_V) && !(*currentp & PTE_S) ){
+    if ( currentp == 0 || (!(*currentp & PTE_V) && !(*currentp & PTE_S)) ){
       handle_pgfault(p, i);
     }
 
     else if (*currentp & PTE_S){
       uint64 blockNO = PTE2BLOCKNO(*currentp);
+      void* page = ukalloc();
+      if (page == 0) return -1;
       *currentp |= PTE_V;
       *currentp &= ~PTE_S;
-      void* page = kalloc();
-      // Begin OP
-      begin_op();
       read_page_from_disk(ROOTDEV, (char*)page, blockNO);
-      bfree_page(ROOTDEV, blockNO);
-      end_op();
-      // End OP
+      swapfree(blockNO);
       *currentp = PA2PTE(page) | PTE_FLAGS(*currentp);
     }
   }
@@ -1,3 +1,21 @@
 #define MADV_NORMAL  0
 #define MADV_WILLNEED 1
 #define MADV_DONTNEED 2
+
+/* Swap-in readahead statistics, returned by swapra(). */
+struct swapra_stat {
+  int window;       /* largest readahead window, in pages */
+  uint64 faults;    /* swap-in page faults */
+  uint64 pages;     /* pages brought in ahead of a fault */
+  uint64 hits;      /* prefetched pages used before the next fault */
+  uint64 misses;    /* prefetched pages not (yet) used by then */
+  uint64 evicted;   /* pages evicted by the page reclaimer */
+};
+
+/* Page fault statistics of a process, returned by faultstat(). */
+struct faultstat {
+  int cluster;      /* pages mapped per lazy fault, at most */
+  uint64 faults;    /* page faults taken */
+  uint64 lazy;      /* faults on not yet allocated heap */
+  uint64 pages;     /* pages mapped by those */
+};
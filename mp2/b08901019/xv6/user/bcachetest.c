@@ -0,0 +1,197 @@
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+void test0(void);
+void test1(void);
+void test2(void);
+
+#define SZ 4096
+char buf[SZ];
+
+#define NCHILD 4    // concurrent readers, at most
+#define NBLOCK 5    // blocks per file; NCHILD*NBLOCK fits in NBUF
+#define ROUNDS 500  // passes over the file per reader
+#define TPS 10      // timer ticks per second (see start.c)
+
+int
+main(int argc, char *argv[])
+{
+  test0();
+  test1();
+  test2();
+  exit(0);
+}
+
+// Sum of the "tot= " counter, i.e. the number of
+// test-and-set spins on the kmem and bcache locks.
+int
+ntas(int print)
+{
+  int n;
+  char *c;
+
+  if (statistics(buf, SZ) <= 0) {
+    fprintf(2, "ntas: no stats\n");
+  }
+  c = strchr(buf, '=');
+  n = atoi(c+2);
+  if(print)
+    printf("%s", buf);
+  return n;
+}
+
+void
+createfile(char *file, int nblock)
+{
+  int fd;
+  char b[BSIZE];
+  int i;
+
+  fd = open(file, O_RDWR | O_CREATE);
+  if(fd < 0){
+    printf("createfile %s failed\n", file);
+    exit(1);
+  }
+  for(i = 0; i < nblock; i++) {
+    b[0] = i;
+    if(write(fd, b, BSIZE) != BSIZE) {
+      printf("write %s failed\n", file);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// Read every block of file rounds times, checking contents.
+void
+readfile(char *file, int nblock, int rounds)
+{
+  char b[BSIZE];
+  int fd;
+
+  for(int r = 0; r < rounds; r++){
+    if ((fd = open(file, O_RDONLY)) < 0) {
+      printf("open %s failed\n", file);
+      exit(1);
+    }
+    for(int i = 0; i < nblock; i++) {
+      if(read(fd, b, BSIZE) != BSIZE) {
+        printf("read %s failed for block %d\n", file, i);
+        exit(1);
+      }
+      if(b[0] != (char)i) {
+        printf("read %s: block %d has wrong contents\n", file, i);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+}
+
+// Start n readers, each on its own file, and wait for them.
+void
+readers(int n, int rounds)
+{
+  char file[2];
+
+  file[1] = '\0';
+  for(int i = 0; i < n; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed");
+      exit(1);
+    }
+    if(pid == 0){
+      file[0] = 'B' + i;
+      readfile(file, NBLOCK, rounds);
+      exit(0);
+    }
+  }
+  for(int i = 0; i < n; i++){
+    wait(0);
+  }
+}
+
+// Concurrent readers of different cached blocks should
+// barely ever spin on a bcache lock.
+void
+test0(void)
+{
+  char file[2];
+  int m, n;
+
+  printf("start test0\n");
+  file[1] = '\0';
+  for(int i = 0; i < NCHILD; i++){
+    file[0] = 'B' + i;
+    unlink(file);
+    createfile(file, NBLOCK);
+  }
+  m = ntas(0);
+  readers(NCHILD, ROUNDS);
+  printf("test0 results:\n");
+  n = ntas(1);
+  if (n-m < 500)
+    printf("test0: OK\n");
+  else
+    printf("test0: FAIL\n");
+}
+
+// Report block lookups per second for 1..NCHILD readers.
+// With per-bucket locks this should scale with the number
+// of harts (make CPUS=n) until readers outnumber harts.
+void
+test1(void)
+{
+  printf("start test1\n");
+  for(int n = 1; n <= NCHILD; n++){
+    int t0 = uptime();
+    readers(n, ROUNDS);
+    int t = uptime() - t0;
+    if(t == 0)
+      t = 1;
+    int lookups = n * ROUNDS * NBLOCK;
+    printf("test1: %d readers: %d lookups in %d ticks, %d lookups/sec\n",
+           n, lookups, t, lookups * TPS / t);
+  }
+  printf("test1 OK\n");
+}
+
+// A file bigger than the cache forces buffers to be
+// recycled between buckets while others read; contents
+// must survive that.
+void
+test2(void)
+{
+  int nblock = 2*NBUF;
+
+  printf("start test2\n");
+  unlink("bigfile");
+  createfile("bigfile", nblock);
+  for(int i = 0; i < 2; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed");
+      exit(1);
+    }
+    if(pid == 0){
+      readfile("bigfile", nblock, 2);
+      exit(0);
+    }
+  }
+  for(int i = 0; i < 2; i++){
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("test2: FAIL\n");
+      exit(1);
+    }
+  }
+  unlink("bigfile");
+  printf("test2 OK\n");
+}
@@ -0,0 +1,56 @@
+//
+// tests for fault-around on lazily allocated heap.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/vm.h"
+#include "user/user.h"
+
+#define PGSIZE 4096
+#define NPAGES 64
+
+// Sweep NPAGES fresh heap pages with the given cluster size
+// and return the number of lazy faults taken.
+int sweep(int cluster) {
+  struct faultstat st0, st;
+
+  faultstat(cluster, &st0);
+  char *base = sbrk(NPAGES * PGSIZE);
+  for (int i = 0; i < NPAGES; i++) {
+    if (base[i * PGSIZE] != 0) {
+      printf("page %d not zero\n", i);
+      exit(1);
+    }
+    base[i * PGSIZE] = i;
+  }
+  for (int i = 0; i < NPAGES; i++) {
+    if (base[i * PGSIZE] != i) {
+      printf("wrong content in page %d\n", i);
+      exit(1);
+    }
+  }
+  faultstat(0, &st);
+  sbrk(-NPAGES * PGSIZE);
+  return st.lazy - st0.lazy;
+}
+
+int main(int argc, char *argv[]) {
+  int old = faultstat(0, 0);
+
+  printf("cluster 1: ");
+  int n1 = sweep(1);
+  printf("%d faults\n", n1);
+
+  printf("cluster 16: ");
+  int n16 = sweep(16);
+  printf("%d faults\n", n16);
+
+  faultstat(old, 0);
+  if (n16 * 4 > n1) {
+    printf("fault-around did not cut faults\n");
+    exit(1);
+  }
+  printf("ALL FAULT TESTS PASSED\n");
+  exit(0);
+}
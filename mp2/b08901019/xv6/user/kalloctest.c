@@ -0,0 +1,117 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NCHILD 2
+#define N 100000
+#define SZ 4096
+
+void test1(void);
+void test2(void);
+char buf[SZ];
+
+int
+main(int argc, char *argv[])
+{
+  test1();
+  test2();
+  exit(0);
+}
+
+// Sum of the "tot= " counter, i.e. the number of
+// test-and-set spins on the kmem and bcache locks.
+int ntas(int print)
+{
+  int n;
+  char *c;
+
+  if (statistics(buf, SZ) <= 0) {
+    fprintf(2, "ntas: no stats\n");
+  }
+  c = strchr(buf, '=');
+  n = atoi(c+2);
+  if(print)
+    printf("%s", buf);
+  return n;
+}
+
+// Allocate and free one page n times. sbrk() is lazy,
+// so touch the page to make the fault handler kalloc() it.
+void
+churn(int n)
+{
+  for(int i = 0; i < n; i++) {
+    char *a = sbrk(PGSIZE);
+    *(int *)(a+4) = 1;
+    char *a1 = sbrk(-PGSIZE);
+    if (a1 != a + PGSIZE) {
+      printf("wrong sbrk\n");
+      exit(1);
+    }
+  }
+}
+
+// Check that concurrent kalloc()/kfree() on several harts
+// hardly ever spin on a kmem lock.
+void test1(void)
+{
+  int n, m;
+  printf("start test1\n");
+  m = ntas(0);
+  for(int i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed");
+      exit(1);
+    }
+    if(pid == 0){
+      churn(N);
+      exit(0);
+    }
+  }
+
+  for(int i = 0; i < NCHILD; i++){
+    wait(0);
+  }
+  printf("test1 results:\n");
+  n = ntas(1);
+  if(n-m < 10)
+    printf("test1 OK\n");
+  else
+    printf("test1 FAIL\n");
+}
+
+// Report allocation throughput for 1..NCHILD concurrent
+// workers. With per-hart free lists pages/tick should
+// grow with the number of harts running the test.
+void test2(void)
+{
+  printf("start test2\n");
+  for(int nchild = 1; nchild <= NCHILD; nchild++){
+    int t0 = uptime();
+    for(int i = 0; i < nchild; i++){
+      int pid = fork();
+      if(pid < 0){
+        printf("fork failed");
+        exit(1);
+      }
+      if(pid == 0){
+        churn(N / NCHILD);
+        exit(0);
+      }
+    }
+    for(int i = 0; i < nchild; i++){
+      wait(0);
+    }
+    int t = uptime() - t0;
+    if(t == 0)
+      t = 1;
+    printf("test2: %d workers: %d pages in %d ticks, %d pages/tick\n",
+           nchild, nchild * (N / NCHILD), t, nchild * (N / NCHILD) / t);
+  }
+  printf("test2 OK\n");
+}
@@ -0,0 +1,81 @@
+//
+// tests for the MLFQ scheduler and nice().
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NHOG 8
+#define NSLEEP 20
+
+// Spin until killed.
+void hog(void) {
+  volatile int x = 0;
+  for (;;)
+    x++;
+}
+
+void test_nice(void) {
+  printf("nice: ");
+  int pid = fork();
+  if (pid < 0) {
+    printf("fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    if (nice(0) != 0 || nice(5) != 5 || nice(100) != 19 || nice(-100) != 0)
+      exit(1);
+    nice(10);
+    int child = fork();
+    if (child == 0)
+      exit(nice(0) == 10 ? 0 : 1);
+    int xstatus;
+    wait(&xstatus);
+    exit(xstatus);
+  }
+  int xstatus;
+  wait(&xstatus);
+  if (xstatus != 0) {
+    printf("wrong nice values\n");
+    exit(1);
+  }
+  printf("ok\n");
+}
+
+// A process that mostly sleeps keeps the top level, so it
+// should not wait behind CPU hogs for long.
+void test_interactive(void) {
+  printf("interactive: ");
+  int pids[NHOG];
+  for (int i = 0; i < NHOG; i++) {
+    if ((pids[i] = fork()) < 0) {
+      printf("fork failed\n");
+      exit(1);
+    }
+    if (pids[i] == 0)
+      hog();
+  }
+
+  int t0 = uptime();
+  for (int i = 0; i < NSLEEP; i++)
+    sleep(1);
+  int t = uptime() - t0;
+
+  for (int i = 0; i < NHOG; i++) {
+    kill(pids[i]);
+    wait(0);
+  }
+  if (t > 4 * NSLEEP) {
+    printf("%d sleeps of 1 tick took %d ticks\n", NSLEEP, t);
+    exit(1);
+  }
+  printf("ok\n");
+}
+
+int main(int argc, char *argv[]) {
+  test_nice();
+  test_interactive();
+  printf("ALL SCHED TESTS PASSED\n");
+  exit(0);
+}
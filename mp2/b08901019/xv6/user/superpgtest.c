@@ -0,0 +1,139 @@
+//
+// tests for 2 MiB superpage mappings of large heaps.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define PGSIZE 4096
+#define SUPERPGSIZE (PGSIZE * 512)
+#define NSUPER 8
+
+// Grow the heap to a superpage boundary, then by n superpages.
+char *grow(int n) {
+  char *top = sbrk(0);
+  uint64 pad = (SUPERPGSIZE - (uint64)top % SUPERPGSIZE) % SUPERPGSIZE;
+  char *base = sbrk(pad + (uint64)n * SUPERPGSIZE);
+  if (base == (char*)-1) {
+    printf("sbrk failed\n");
+    exit(1);
+  }
+  return base + pad;
+}
+
+void fill(char *base, int npages, int tag) {
+  for (int i = 0; i < npages; i++)
+    *(int*)(base + i * PGSIZE) = i + tag;
+}
+
+int check(char *base, int npages, int tag) {
+  for (int i = 0; i < npages; i++)
+    if (*(int*)(base + i * PGSIZE) != i + tag)
+      return -1;
+  return 0;
+}
+
+// Every page of a freshly grown heap reads as zero and
+// keeps what is written to it.
+void test_heap(void) {
+  printf("heap: ");
+  char *top = sbrk(0);
+  char *base = grow(NSUPER);
+  int npages = NSUPER * 512;
+
+  for (int i = 0; i < npages; i++) {
+    if (*(int*)(base + i * PGSIZE + 8) != 0) {
+      printf("page %d not zero\n", i);
+      exit(1);
+    }
+  }
+  fill(base, npages, 1);
+  if (check(base, npages, 1) != 0) {
+    printf("wrong content\n");
+    exit(1);
+  }
+  sbrk(top - (char*)sbrk(0));
+  printf("ok\n");
+}
+
+// Shrinking into the middle of a superpage keeps the part
+// below the break.
+void test_shrink(void) {
+  printf("shrink: ");
+  char *top = sbrk(0);
+  char *base = grow(2);
+  fill(base, 1024, 2);
+
+  sbrk(-(SUPERPGSIZE + SUPERPGSIZE / 2));
+  if (check(base, 256, 2) != 0) {
+    printf("wrong content\n");
+    exit(1);
+  }
+  sbrk(top - (char*)sbrk(0));
+  printf("ok\n");
+}
+
+// fork() shares the heap copy-on-write; writes by the
+// child must not show in the parent.
+void test_fork(void) {
+  printf("fork: ");
+  char *top = sbrk(0);
+  char *base = grow(2);
+  fill(base, 1024, 3);
+
+  int pid = fork();
+  if (pid < 0) {
+    printf("fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    if (check(base, 1024, 3) != 0)
+      exit(1);
+    fill(base, 1024, 4);
+    exit(check(base, 1024, 4) == 0 ? 0 : 1);
+  }
+  int xstatus;
+  wait(&xstatus);
+  if (xstatus != 0 || check(base, 1024, 3) != 0) {
+    printf("failed\n");
+    exit(1);
+  }
+  sbrk(top - (char*)sbrk(0));
+  printf("ok\n");
+}
+
+// Reads and writes by the kernel into a superpage.
+void test_syscall(void) {
+  printf("syscall: ");
+  char *top = sbrk(0);
+  char *base = grow(1);
+  int fds[2];
+
+  if (pipe(fds) < 0) {
+    printf("pipe failed\n");
+    exit(1);
+  }
+  memset(base, 'x', 100);
+  if (write(fds[1], base, 100) != 100 || read(fds[0], base + SUPERPGSIZE / 2, 100) != 100) {
+    printf("pipe i/o failed\n");
+    exit(1);
+  }
+  if (memcmp(base, base + SUPERPGSIZE / 2, 100) != 0) {
+    printf("wrong content\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(top - (char*)sbrk(0));
+  printf("ok\n");
+}
+
+int main(int argc, char *argv[]) {
+  test_heap();
+  test_shrink();
+  test_fork();
+  test_syscall();
+  printf("ALL SUPERPAGE TESTS PASSED\n");
+  exit(0);
+}
@@ -0,0 +1,218 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/vm.h"
+#include "kernel/memlayout.h"
+#include "user/user.h"
+
+#define PGSIZE 4096
+#define NPAGES 32
+
+// Fill npages pages at base with a pattern that depends on
+// the page number and tag, so misplaced pages are caught.
+void fill(char *base, int npages, int tag) {
+  for (int i = 0; i < npages; i++) {
+    int *p = (int*)(base + i * PGSIZE);
+    for (int j = 0; j < PGSIZE / sizeof(int); j += 64)
+      p[j] = i * 1000 + j + tag;
+  }
+}
+
+int check(char *base, int npages, int tag) {
+  for (int i = 0; i < npages; i++) {
+    int *p = (int*)(base + i * PGSIZE);
+    for (int j = 0; j < PGSIZE / sizeof(int); j += 64)
+      if (p[j] != i * 1000 + j + tag)
+        return -1;
+  }
+  return 0;
+}
+
+// Swap a whole region out and fault it back in.
+void test_region(void) {
+  printf("region: ");
+  char *base = sbrk(NPAGES * PGSIZE);
+  fill(base, NPAGES, 1);
+
+  int t0 = uptime();
+  if (madvise(base, NPAGES * PGSIZE, MADV_DONTNEED) != 0) {
+    printf("madvise failed\n");
+    exit(1);
+  }
+  int t = uptime() - t0;
+
+  if (check(base, NPAGES, 1) != 0) {
+    printf("wrong content after swap-in\n");
+    exit(1);
+  }
+  sbrk(-NPAGES * PGSIZE);
+  printf("ok (%d pages out in %d ticks)\n", NPAGES, t);
+}
+
+// Holes in the region split it into several runs.
+void test_holes(void) {
+  printf("holes: ");
+  char *base = sbrk(NPAGES * PGSIZE);
+  // touch every third page only; the rest stay unallocated.
+  for (int i = 0; i < NPAGES; i += 3)
+    *(int*)(base + i * PGSIZE) = i + 7;
+
+  if (madvise(base, NPAGES * PGSIZE, MADV_DONTNEED) != 0) {
+    printf("madvise failed\n");
+    exit(1);
+  }
+  for (int i = 0; i < NPAGES; i++) {
+    int want = (i % 3 == 0) ? i + 7 : 0;
+    if (*(int*)(base + i * PGSIZE) != want) {
+      printf("wrong content in page %d\n", i);
+      exit(1);
+    }
+  }
+  sbrk(-NPAGES * PGSIZE);
+  printf("ok\n");
+}
+
+// A child swaps its copy of the region out; the parent's
+// copy must not change.
+void test_fork(void) {
+  printf("fork: ");
+  char *base = sbrk(NPAGES * PGSIZE);
+  fill(base, NPAGES, 2);
+
+  int pid = fork();
+  if (pid < 0) {
+    printf("fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    if (madvise(base, NPAGES * PGSIZE, MADV_DONTNEED) != 0)
+      exit(1);
+    fill(base, NPAGES, 3);
+    exit(check(base, NPAGES, 3) == 0 ? 0 : 1);
+  }
+  int xstatus;
+  wait(&xstatus);
+  if (xstatus != 0 || check(base, NPAGES, 2) != 0) {
+    printf("failed\n");
+    exit(1);
+  }
+  sbrk(-NPAGES * PGSIZE);
+  printf("ok\n");
+}
+
+// A sequential scan over a swapped-out region should fault
+// much less than once per page, and the readahead should be used.
+void test_readahead(void) {
+  struct swapra_stat st0, st;
+
+  printf("readahead: ");
+  char *base = sbrk(NPAGES * PGSIZE);
+  fill(base, NPAGES, 4);
+  if (madvise(base, NPAGES * PGSIZE, MADV_DONTNEED) != 0) {
+    printf("madvise failed\n");
+    exit(1);
+  }
+
+  swapra(-1, &st0);
+  if (check(base, NPAGES, 4) != 0) {
+    printf("wrong content after swap-in\n");
+    exit(1);
+  }
+  swapra(-1, &st);
+  int faults = st.faults - st0.faults;
+  int hits = st.hits - st0.hits;
+  int misses = st.misses - st0.misses;
+  if (st.window > 0 && faults >= NPAGES) {
+    printf("%d faults for %d pages\n", faults, NPAGES);
+    exit(1);
+  }
+  sbrk(-NPAGES * PGSIZE);
+  printf("ok (%d faults, %d hits, %d misses, window %d)\n",
+         faults, hits, misses, st.window);
+}
+
+// Touch more memory than the machine has; the page reclaimer
+// must push cold pages to swap to make room.
+void test_pressure(void) {
+  struct swapra_stat st0, st;
+  int npages = (PHYSTOP - KERNBASE) / PGSIZE / 4 * 5;
+
+  printf("pressure: ");
+  swapra(-1, &st0);
+  char *base = sbrk(npages * PGSIZE);
+  if (base == (char*)-1) {
+    printf("sbrk failed\n");
+    exit(1);
+  }
+  for (int i = 0; i < npages; i++)
+    *(int*)(base + i * PGSIZE) = i;
+  for (int i = 0; i < npages; i++) {
+    if (*(int*)(base + i * PGSIZE) != i) {
+      printf("wrong content in page %d\n", i);
+      exit(1);
+    }
+  }
+  swapra(-1, &st);
+  sbrk(-npages * PGSIZE);
+  printf("ok (%d pages, %d evicted)\n", npages, (int)(st.evicted - st0.evicted));
+}
+
+// Pipes copy user memory while holding a spinlock, so a
+// swapped-out buffer must be brought in before that.
+void test_pipe(void) {
+  printf("pipe: ");
+  char *src = sbrk(2 * PGSIZE);
+  char *dst = sbrk(2 * PGSIZE);
+  int fds[2];
+
+  fill(src, 2, 4);
+  memset(dst, 0, 2 * PGSIZE);
+  if (pipe(fds) < 0) {
+    printf("pipe failed\n");
+    exit(1);
+  }
+  if (madvise(src, 4 * PGSIZE, MADV_DONTNEED) != 0) {
+    printf("madvise failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if (pid < 0) {
+    printf("fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    // fork() read dst back in for the child; swap it out
+    // again and read into it.
+    close(fds[1]);
+    if (madvise(dst, 2 * PGSIZE, MADV_DONTNEED) != 0)
+      exit(1);
+    for (int n = 0, r; n < 2 * PGSIZE; n += r)
+      if ((r = read(fds[0], dst + n, 2 * PGSIZE - n)) <= 0)
+        exit(1);
+    exit(check(dst, 2, 4) == 0 ? 0 : 1);
+  }
+  close(fds[0]);
+  if (write(fds[1], src, 2 * PGSIZE) != 2 * PGSIZE) {
+    printf("write from swapped-out buffer failed\n");
+    exit(1);
+  }
+  close(fds[1]);
+  int xstatus;
+  wait(&xstatus);
+  if (xstatus != 0) {
+    printf("wrong content through pipe\n");
+    exit(1);
+  }
+  sbrk(-4 * PGSIZE);
+  printf("ok\n");
+}
+
+int main(int argc, char *argv[]) {
+  test_region();
+  test_holes();
+  test_fork();
+  test_readahead();
+  test_pressure();
+  test_pipe();
+  printf("ALL SWAP TESTS PASSED\n");
+  exit(0);
+}
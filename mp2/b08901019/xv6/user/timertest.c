@@ -0,0 +1,121 @@
+//
+// tests for deadline timers and nanosleep().
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MS 1000000ULL  // nanoseconds
+#define NSHORT 50
+#define NORDER 5
+
+// Many short sleeps must not each be rounded up to a tick
+// (100 ms).
+void test_short(void) {
+  printf("short: ");
+  int t0 = uptime();
+  for (int i = 0; i < NSHORT; i++)
+    if (nanosleep(1 * MS) < 0) {
+      printf("nanosleep failed\n");
+      exit(1);
+    }
+  int t = uptime() - t0;
+  if (t > NSHORT / 5) {
+    printf("%d sleeps of 1 ms took %d ticks\n", NSHORT, t);
+    exit(1);
+  }
+  printf("ok\n");
+}
+
+// A long sleep lasts at least as long as asked.
+void test_long(void) {
+  printf("long: ");
+  int t0 = uptime();
+  nanosleep(1000 * MS);
+  int t = uptime() - t0;
+  if (t < 9 || t > 20) {
+    printf("1 s sleep took %d ticks\n", t);
+    exit(1);
+  }
+  t0 = uptime();
+  sleep(5);
+  t = uptime() - t0;
+  if (t < 4 || t > 10) {
+    printf("sleep(5) took %d ticks\n", t);
+    exit(1);
+  }
+  printf("ok\n");
+}
+
+// Sleepers wake in deadline order, whatever order they
+// went to sleep in.
+void test_order(void) {
+  printf("order: ");
+  int fds[2];
+  if (pipe(fds) < 0) {
+    printf("pipe failed\n");
+    exit(1);
+  }
+  for (int i = 0; i < NORDER; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      printf("fork failed\n");
+      exit(1);
+    }
+    if (pid == 0) {
+      char c = 'a' + (NORDER - 1 - i);
+      nanosleep((NORDER - i) * 40 * MS);
+      write(fds[1], &c, 1);
+      exit(0);
+    }
+  }
+  char buf[NORDER];
+  for (int i = 0; i < NORDER; i++) {
+    if (read(fds[0], &buf[i], 1) != 1) {
+      printf("read failed\n");
+      exit(1);
+    }
+    wait(0);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for (int i = 0; i < NORDER; i++)
+    if (buf[i] != 'a' + i) {
+      printf("woke out of order\n");
+      exit(1);
+    }
+  printf("ok\n");
+}
+
+// kill() cuts a sleep short.
+void test_kill(void) {
+  printf("kill: ");
+  int pid = fork();
+  if (pid < 0) {
+    printf("fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    nanosleep(100000 * MS);
+    exit(0);
+  }
+  nanosleep(50 * MS);
+  int t0 = uptime();
+  kill(pid);
+  wait(0);
+  if (uptime() - t0 > 5) {
+    printf("killed sleeper took too long to exit\n");
+    exit(1);
+  }
+  printf("ok\n");
+}
+
+int main(int argc, char *argv[]) {
+  test_short();
+  test_long();
+  test_order();
+  test_kill();
+  printf("ALL TIMER TESTS PASSED\n");
+  exit(0);
+}
@@ -1,6 +1,8 @@
 struct stat;
 struct rtcdate;
 struct sysinfo;
+struct swapra_stat;
+struct faultstat;
 
 // system calls
 int fork(void);
@@ -34,6 +36,10 @@ int ugetpid(void);
 #endif
 int vmprint(void);
 int madvise(void *base, int len, int advise);
+int swapra(int window, struct swapra_stat *st);
+int faultstat(int cluster, struct faultstat *st);
+int nice(int incr);
+int nanosleep(uint64 ns);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -40,3 +40,7 @@ entry("connect");
 entry("pgaccess");
 entry("vmprint");
 entry("madvise");
+entry("swapra");
+entry("faultstat");
+entry("nice");
+entry("nanosleep");
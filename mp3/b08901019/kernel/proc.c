@@ -121,6 +121,7 @@ found:
   p->context_id = -1;
   p->handler_ptr = 0;
   p->handler_arg = 0;
+  p->context_data = 0;
   for (int i = 0; i < MAX_THRD_NUM; i++){
     p->context_idle[i] = 1;
   }
@@ -157,6 +158,9 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->context_data)
+    kfree((void*)p->context_data);
+  p->context_data = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
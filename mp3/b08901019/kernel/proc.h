@@ -86,6 +86,46 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// User registers of a context stored by thrdstop() and
+// friends, see thrd.c. The pc and the callee-saved registers
+// come first: a context saved at a system call keeps only
+// those. MAX_THRD_NUM of them fill one page.
+struct thrdctx {
+  uint64 epc;
+  uint64 ra;
+  uint64 sp;
+  uint64 gp;
+  uint64 tp;
+  uint64 s0;
+  uint64 s1;
+  uint64 s2;
+  uint64 s3;
+  uint64 s4;
+  uint64 s5;
+  uint64 s6;
+  uint64 s7;
+  uint64 s8;
+  uint64 s9;
+  uint64 s10;
+  uint64 s11;
+  // caller-saved, only kept when interrupted by the timer.
+  uint64 t0;
+  uint64 t1;
+  uint64 t2;
+  uint64 t3;
+  uint64 t4;
+  uint64 t5;
+  uint64 t6;
+  uint64 a0;
+  uint64 a1;
+  uint64 a2;
+  uint64 a3;
+  uint64 a4;
+  uint64 a5;
+  uint64 a6;
+  uint64 a7;
+};
+
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -107,8 +147,9 @@ struct proc {
   int context_id;
   uint64 handler_ptr;
   uint64 handler_arg;
-  struct trapframe context_data[MAX_THRD_NUM];
+  struct thrdctx *context_data; // MAX_THRD_NUM contexts, a page allocated on first use
   int context_idle[MAX_THRD_NUM];
+  int context_full[MAX_THRD_NUM]; // saved with the caller-saved registers
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -120,3 +161,6 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 };
+
+// thrd.c
+void thrdsave(struct proc*, int, int);
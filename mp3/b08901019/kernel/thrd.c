@@ -7,6 +7,78 @@
 #include "spinlock.h"
 #include "proc.h"
 
+// Contexts live in one page per process, allocated by the
+// first thrdstop() that needs an ID, so processes that never
+// use user-level threads pay nothing for them.
+//
+// A context stored at a system call (cancelthrdstop(),
+// thrdswitch()) is a voluntary switch: the caller-saved
+// registers are dead across the call, so only the pc and the
+// callee-saved registers are kept. Only a context stopped by
+// the timer needs all of them.
+
+#define SAVE(r)    c->r = tf->r;
+#define RESTORE(r) tf->r = c->r;
+
+// Store the user registers of p as context id.
+void
+thrdsave(struct proc *p, int id, int full)
+{
+  struct thrdctx *c;
+  struct trapframe *tf = p->trapframe;
+
+  if(p->context_data == 0 || id < 0 || id >= MAX_THRD_NUM)
+    return;
+  c = &p->context_data[id];
+  SAVE(epc) SAVE(ra) SAVE(sp) SAVE(gp) SAVE(tp)
+  SAVE(s0) SAVE(s1) SAVE(s2) SAVE(s3) SAVE(s4) SAVE(s5)
+  SAVE(s6) SAVE(s7) SAVE(s8) SAVE(s9) SAVE(s10) SAVE(s11)
+  if(full){
+    SAVE(t0) SAVE(t1) SAVE(t2) SAVE(t3) SAVE(t4) SAVE(t5) SAVE(t6)
+    SAVE(a0) SAVE(a1) SAVE(a2) SAVE(a3) SAVE(a4) SAVE(a5) SAVE(a6) SAVE(a7)
+  }
+  p->context_full[id] = full;
+}
+
+// Load context id into the user registers of p. Returns the
+// value for the system call to return, which becomes a0: the
+// saved a0 of a full context, else 0.
+static uint64
+thrdrestore(struct proc *p, int id)
+{
+  struct thrdctx *c = &p->context_data[id];
+  struct trapframe *tf = p->trapframe;
+
+  RESTORE(epc) RESTORE(ra) RESTORE(sp) RESTORE(gp) RESTORE(tp)
+  RESTORE(s0) RESTORE(s1) RESTORE(s2) RESTORE(s3) RESTORE(s4) RESTORE(s5)
+  RESTORE(s6) RESTORE(s7) RESTORE(s8) RESTORE(s9) RESTORE(s10) RESTORE(s11)
+  if(!p->context_full[id])
+    return 0;
+  RESTORE(t0) RESTORE(t1) RESTORE(t2) RESTORE(t3) RESTORE(t4) RESTORE(t5) RESTORE(t6)
+  RESTORE(a1) RESTORE(a2) RESTORE(a3) RESTORE(a4) RESTORE(a5) RESTORE(a6) RESTORE(a7)
+  return c->a0;
+}
+
+// Is id a context assigned by thrdstop()?
+static int
+thrdvalid(struct proc *p, int id)
+{
+  return id >= 0 && id < MAX_THRD_NUM && p->context_data != 0 && !p->context_idle[id];
+}
+
+// Start the timer: call handler(handler_arg) after delay
+// ticks, first storing the running context as context_id.
+static void
+thrdarm(struct proc *p, int delay, int context_id, uint64 handler, uint64 handler_arg)
+{
+  p->delay = delay;
+  p->thrdstopping = 1;
+  p->num_ticks = 0;
+  p->context_id = context_id;
+  p->handler_ptr = handler;
+  p->handler_arg = handler_arg;
+}
+
 // for mp3
 uint64
 sys_thrdstop(void)
@@ -23,41 +95,27 @@ sys_thrdstop(void)
   if (argaddr(3, &handler_arg) < 0)
     return -1;
 
-  //struct proc *proc = myproc();
-
-  //TODO: mp3
   struct proc *proc = myproc();
-  proc->delay = delay;
-  proc->thrdstopping = 1;
-  proc->num_ticks = 0;
-  proc->handler_ptr = handler;
-  proc->handler_arg = handler_arg;
-
-  int find_idle = 0;
-  int context_id = 0;
-  // if (copyin(proc->pagetable, (char*)&(context_id), context_id_ptr, proc->sz) == 0){
-  if (copyin(proc->pagetable, (char*)&(context_id), context_id_ptr, sizeof(int)) == 0){
-    if (context_id == -1){
-      for (int i=0; i < MAX_THRD_NUM; i++){
-        if (proc->context_idle[i] == 1){
-          proc->context_idle[i] = 0;
-          proc->context_id = i;
-          copyout(proc->pagetable, context_id_ptr, (char*)&(i), sizeof(int));
-          find_idle = 1;
-          break;
-        }
-      }
-      if (find_idle == 0){
-        return -1;
-      }
-    }
-    else{
-      proc->context_id = context_id;
-      // copyout(proc->pagetable, context_id_ptr, (char*)&(context_id), proc->sz);
-      copyout(proc->pagetable, context_id_ptr, (char*)&(context_id), sizeof(int));
-    }
+  int context_id;
+
+  if (copyin(proc->pagetable, (char*)&context_id, context_id_ptr, sizeof(int)) < 0)
+    return -1;
+  if (context_id == -1){
+    if (proc->context_data == 0 && (proc->context_data = kalloc()) == 0)
+      return -1;
+    for (context_id = 0; context_id < MAX_THRD_NUM; context_id++)
+      if (proc->context_idle[context_id])
+        break;
+    if (context_id == MAX_THRD_NUM)
+      return -1;
+    if (copyout(proc->pagetable, context_id_ptr, (char*)&context_id, sizeof(int)) < 0)
+      return -1;
+    proc->context_idle[context_id] = 0;
+  } else if (!thrdvalid(proc, context_id)){
+    return -1;
   }
 
+  thrdarm(proc, delay, context_id, handler, handler_arg);
   return 0;
 }
 
@@ -71,27 +129,18 @@ sys_cancelthrdstop(void)
   if (argint(1, &is_exit) < 0)
     return -1;
 
-  if (context_id < 0 || context_id >= MAX_THRD_NUM) {
-    return -1;
-  }
+  struct proc *proc = myproc();
 
-  //struct proc *proc = myproc();
+  if (!thrdvalid(proc, context_id))
+    return -1;
 
-  //TODO: mp3
-  struct proc *proc = myproc();
   proc->thrdstopping = 0;
-
-  if (is_exit == 0){
-    int i = proc->context_id;
-    memmove( &(proc->context_data[i]), (proc->trapframe), sizeof(struct trapframe) );
-    // (proc->context_data[i]) = *(proc->trapframe);
-  }
-  else if (is_exit == 1){
+  if (is_exit == 0)
+    thrdsave(proc, context_id, 0);
+  else if (is_exit == 1)
     proc->context_idle[context_id] = 1;
-  }
 
   return proc->num_ticks;
-  // return 0;
 }
 
 // for mp3
@@ -102,15 +151,46 @@ sys_thrdresume(void)
   if (argint(0, &context_id) < 0)
     return -1;
 
-  //struct proc *proc = myproc();
-
-  //TODO: mp3
   struct proc *proc = myproc();
+
+  if (!thrdvalid(proc, context_id))
+    return -1;
   proc->context_id = context_id;
+  return thrdrestore(proc, context_id);
+}
+
+// Switch user-level threads in one system call: cancel the
+// timer, store the running context as save_id (unless it is
+// -1, for a thread that exits), start a timer of delay ticks
+// for resume_id (unless delay is 0), and resume resume_id.
+// Does the work of cancelthrdstop(), thrdstop() and
+// thrdresume() with one kernel crossing instead of three.
+uint64
+sys_thrdswitch(void)
+{
+  int save_id, resume_id, delay;
+  uint64 handler, handler_arg;
+  if (argint(0, &save_id) < 0)
+    return -1;
+  if (argint(1, &resume_id) < 0)
+    return -1;
+  if (argint(2, &delay) < 0)
+    return -1;
+  if (argaddr(3, &handler) < 0)
+    return -1;
+  if (argaddr(4, &handler_arg) < 0)
+    return -1;
 
-  int j = proc->context_id;
-  memmove( (proc->trapframe), &(proc->context_data[j]), sizeof(struct trapframe) );
-  // (proc->trapframe) = &(proc->context_data[j]);
+  struct proc *proc = myproc();
 
-  return 0;
+  if ((save_id != -1 && !thrdvalid(proc, save_id)) || !thrdvalid(proc, resume_id))
+    return -1;
+
+  proc->thrdstopping = 0;
+  if (save_id != -1)
+    thrdsave(proc, save_id, 0);
+  if (delay > 0)
+    thrdarm(proc, delay, resume_id, handler, handler_arg);
+  proc->context_id = resume_id;
+  return thrdrestore(proc, resume_id);
 }
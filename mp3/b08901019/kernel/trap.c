@@ -84,8 +84,7 @@ usertrap(void)
     }
     if (p->num_ticks == p->delay){
       p->thrdstopping = 0;
-      int i = p->context_id;
-      memmove( &(p->context_data[i]), (p->trapframe), sizeof(struct trapframe) );
+      thrdsave(p, p->context_id, 1);
     }
 
     yield();
@@ -181,8 +180,7 @@ kerneltrap()
     }
     if (p->num_ticks == p->delay){
       p->thrdstopping = 0;
-      int j = p->context_id;
-      memmove( &(p->context_data[j]), (p->trapframe), sizeof(struct trapframe) );
+      thrdsave(p, p->context_id, 1);
     }
 
     yield();
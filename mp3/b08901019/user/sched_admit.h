@@ -0,0 +1,8 @@
+/*
+ * Admission control and statistics of the real-time schedulers,
+ * in threads_sched.c. Include after user/threads_sched.h.
+ */
+int sched_admit(struct threads_sched_result (*sched)(struct threads_sched_args),
+                int ID, int c, int p);
+void sched_leave(int ID);
+void threads_sched_report(void);
@@ -0,0 +1,202 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/list.h"
+#include "user/threads.h"
+#include "user/threads_sched.h"
+#include "user/sched_admit.h"
+
+#define HZ 10       // ticks per second
+#define MAXN 512
+
+/*
+ * Scheduler microbenchmark: calls schedule_edf() and
+ * schedule_rm() on synthetic run and release queues of
+ * n threads and reports scheduling decisions per second.
+ * First it checks admission control on small thread sets.
+ */
+
+static struct thread threads[MAXN];
+static struct release_queue_entry entries[MAXN];
+
+/* Put n threads half in the run queue and half in the release queue. */
+static void setup(int n, struct list_head *run_queue, struct list_head *release_queue)
+{
+    INIT_LIST_HEAD(run_queue);
+    INIT_LIST_HEAD(release_queue);
+    for (int i = 0; i < n; i++) {
+        struct thread *th = &threads[i];
+        memset(th, 0, sizeof(*th));
+        th->ID = i;
+        th->period = 10 + (i * 37) % 90;
+        th->processing_time = 1 + i % 5;
+        if (i % 2 == 0) {
+            th->remaining_time = th->processing_time;
+            th->current_deadline = th->period;
+            list_add_tail(&th->thread_list, run_queue);
+        } else {
+            entries[i].thrd = th;
+            entries[i].release_time = 1 + (i * 13) % th->period;
+            list_add_tail(&entries[i].thread_list, release_queue);
+        }
+    }
+}
+
+/* Run sched for about a second and return decisions per second. */
+static int bench(struct threads_sched_result (*sched)(struct threads_sched_args), int n)
+{
+    struct list_head run_queue, release_queue;
+    struct threads_sched_args args;
+    int decisions = 0, t0, t1;
+
+    setup(n, &run_queue, &release_queue);
+    args.current_time = 0;
+    args.run_queue = &run_queue;
+    args.release_queue = &release_queue;
+
+    t0 = uptime();
+    while (uptime() == t0)
+        ;
+    t0 = uptime();
+    do {
+        for (int i = 0; i < 100; i++)
+            sched(args);
+        decisions += 100;
+        t1 = uptime();
+    } while (t1 - t0 < HZ);
+    return decisions * HZ / (t1 - t0);
+}
+
+/*
+ * Thread sets offered to sched_admit() one thread at a time.
+ * All but the last thread must be admitted; the last one is
+ * admitted or refused as expected.
+ */
+struct taskset {
+    char *name;
+    struct threads_sched_result (*sched)(struct threads_sched_args);
+    int n;
+    int c[4];
+    int p[4];
+    int last;       // expected sched_admit() of the last thread
+};
+
+static struct taskset sets[] = {
+    { "edf U=1", schedule_edf, 3, { 1, 1, 1 }, { 2, 3, 6 }, 0 },
+    { "edf U>1", schedule_edf, 3, { 1, 1, 1 }, { 2, 3, 5 }, -1 },
+    { "rm under bound", schedule_rm, 2, { 1, 1 }, { 4, 5 }, 0 },
+    { "rm U=1 harmonic", schedule_rm, 3, { 1, 1, 2 }, { 2, 4, 8 }, 0 },
+    { "rm U<1 infeasible", schedule_rm, 2, { 2, 4 }, { 5, 7 }, -1 },
+};
+#define NSETS (sizeof(sets) / sizeof(sets[0]))
+
+static void fail(struct taskset *s, char *what)
+{
+    printf("%s: %s\n", s->name, what);
+    exit(1);
+}
+
+/*
+ * Run set s under its scheduler for ticks ticks, every thread
+ * released at 0 and then once a period, with IDs from base.
+ * Returns -1 if a thread misses its deadline.
+ */
+static int simulate(struct taskset *s, int base, int ticks)
+{
+    struct list_head run_queue, release_queue;
+    struct threads_sched_args args;
+    struct threads_sched_result r;
+    struct thread *th;
+
+    INIT_LIST_HEAD(&run_queue);
+    INIT_LIST_HEAD(&release_queue);
+    for (int i = 0; i < s->n; i++) {
+        th = &threads[i];
+        memset(th, 0, sizeof(*th));
+        th->ID = base + i;
+        th->processing_time = s->c[i];
+        th->period = s->p[i];
+        entries[i].thrd = th;
+        entries[i].release_time = 0;
+        list_add_tail(&entries[i].thread_list, &release_queue);
+    }
+    args.run_queue = &run_queue;
+    args.release_queue = &release_queue;
+
+    for (int now = 0; now < ticks; ) {
+        // a thread with no time left waits for its release.
+        for (int i = 0; i < s->n; i++) {
+            th = &threads[i];
+            if (th->remaining_time == 0 && entries[i].release_time <= now) {
+                list_del(&entries[i].thread_list);
+                th->remaining_time = th->processing_time;
+                th->current_deadline = entries[i].release_time + th->period;
+                list_add_tail(&th->thread_list, &run_queue);
+            }
+        }
+        args.current_time = now;
+        r = s->sched(args);
+        if (r.scheduled_thread_list_member == &run_queue) {
+            now += r.allocated_time;
+            continue;
+        }
+        if (r.allocated_time == 0)
+            return -1;
+        th = list_entry(r.scheduled_thread_list_member, struct thread, thread_list);
+        now += r.allocated_time;
+        th->remaining_time -= r.allocated_time;
+        if (th->remaining_time == 0) {
+            struct release_queue_entry *rqe = &entries[th->ID - base];
+            list_del(&th->thread_list);
+            rqe->release_time = th->current_deadline;
+            list_add_tail(&rqe->thread_list, &release_queue);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Check sched_admit() and sched_leave() on each set. A set that
+ * is admitted must then run without missing a deadline; after a
+ * refusal, the first thread leaving must make room for the last.
+ */
+static void admission(void)
+{
+    int base = 0;
+
+    for (struct taskset *s = sets; s < sets + NSETS; s++, base += 4) {
+        int last = s->n - 1;
+        for (int i = 0; i < last; i++)
+            if (sched_admit(s->sched, base + i, s->c[i], s->p[i]) < 0)
+                fail(s, "refused");
+        if (sched_admit(s->sched, base + last, s->c[last], s->p[last]) != s->last)
+            fail(s, s->last ? "admitted" : "refused");
+        if (s->last == 0 && simulate(s, base, 100) < 0)
+            fail(s, "missed a deadline");
+        if (s->last < 0) {
+            sched_leave(base);
+            if (sched_admit(s->sched, base + last, s->c[last], s->p[last]) < 0)
+                fail(s, "refused after a thread left");
+        }
+        for (int i = 0; i < s->n; i++)
+            sched_leave(base + i);
+        printf("%s: ok\n", s->name);
+    }
+    threads_sched_report();
+}
+
+int main(int argc, char *argv[])
+{
+    int max = MAXN;
+
+    if (argc > 1)
+        max = atoi(argv[1]);
+    if (max < 2 || max > MAXN) {
+        fprintf(2, "usage: schedbench [threads <= %d]\n", MAXN);
+        exit(1);
+    }
+    admission();
+    printf("threads\tedf/s\trm/s\n");
+    for (int n = 2; n <= max; n *= 2)
+        printf("%d\t%d\t%d\n", n, bench(schedule_edf, n), bench(schedule_rm, n));
+    exit(0);
+}
@@ -3,6 +3,7 @@
 #include "user/list.h"
 #include "user/threads.h"
 #include "user/threads_sched.h"
+#include "user/sched_admit.h"
 
 #define NULL 0
 
@@ -29,213 +30,357 @@ struct threads_sched_result schedule_default(struct threads_sched_args args)
     return r;
 }
 
-// Minimum of three elements !
-// int Mini(int a, int b, int c)
-// {
-//     if ( (a<b) && (a<c) ){
-//         return a;
-//     }
-//     else if ( (b<a) && (b<c) ){
-//         return b;
-//     }
-//     else{
-//         return c;
-//     }
-// }
-
-/* Earliest-Deadline-First scheduling */
-struct threads_sched_result schedule_edf(struct threads_sched_args args)
+/*
+ * Priority orders of the real-time schedulers. Threads that
+ * missed their deadline come first, by ID; the rest go by
+ * deadline (EDF) or period (RM), with ID breaking ties.
+ *
+ * Under RM this is a change: the old scan only preferred a
+ * smaller ID while its current pick had missed, so whether a
+ * missed thread ran before a shorter-period one depended on
+ * queue order. Now a missed thread always runs first, and is
+ * given no time, so that the library handles the miss at once.
+ * Under EDF a missed deadline is already the earliest one.
+ */
+static int missed_first(int now, struct thread *a, struct thread *b, int *order)
 {
-    struct thread *thread_with_earliest_deadline = NULL;
-    struct thread *th = NULL;
-    list_for_each_entry(th, args.run_queue, thread_list) {
-        if (thread_with_earliest_deadline == NULL){
-            thread_with_earliest_deadline = th;
-        }
-        else if (thread_with_earliest_deadline->current_deadline <= args.current_time){
-            if (th->ID < thread_with_earliest_deadline->ID){
-                thread_with_earliest_deadline = th;
-            }
-        }
-        else if ( (th->current_deadline == thread_with_earliest_deadline->current_deadline && th->ID < thread_with_earliest_deadline->ID) || (th->current_deadline < thread_with_earliest_deadline->current_deadline) ){
-            thread_with_earliest_deadline = th;
-        }
+    int am = a->current_deadline <= now;
+    int bm = b->current_deadline <= now;
+
+    if (am != bm) {
+        *order = am;
+        return 1;
     }
+    if (am) {
+        *order = a->ID < b->ID;
+        return 1;
+    }
+    return 0;
+}
 
+static int edf_before(int now, struct thread *a, struct thread *b)
+{
+    int order;
 
+    if (missed_first(now, a, b, &order))
+        return order;
+    if (a->current_deadline != b->current_deadline)
+        return a->current_deadline < b->current_deadline;
+    return a->ID < b->ID;
+}
 
-    struct threads_sched_result r;
+static int rm_before(int now, struct thread *a, struct thread *b)
+{
+    int order;
 
-    if (thread_with_earliest_deadline == NULL){
-        struct release_queue_entry *higher_rqe = NULL;
-        struct release_queue_entry *rqe = NULL;
-        int release_time;
-
-        list_for_each_entry(rqe, args.release_queue, thread_list){
-            if (higher_rqe == NULL){
-                higher_rqe = rqe;
-            }
-            else if (rqe->release_time < higher_rqe->release_time){
-                higher_rqe = rqe;
-            }
-        }
-        release_time = higher_rqe->release_time;
-        r.scheduled_thread_list_member = args.run_queue;
-        r.allocated_time = release_time-args.current_time;
-    }
+    if (missed_first(now, a, b, &order))
+        return order;
+    if (a->period != b->period)
+        return a->period < b->period;
+    return a->ID < b->ID;
+}
 
-    else if (thread_with_earliest_deadline->current_deadline <= args.current_time){
-        r.scheduled_thread_list_member = &thread_with_earliest_deadline->thread_list;
-        r.allocated_time = 0;
-    }
+/* Does the release of rqe preempt th under EDF? */
+static int edf_preempts(struct release_queue_entry *rqe, struct thread *th)
+{
+    int deadline = rqe->release_time + rqe->thrd->period;
 
-    else{
-        struct release_queue_entry *higher_rqe = NULL;
-        struct release_queue_entry *rqe = NULL;
-
-        // int allo_time = thread_with_earliest_deadline->remaining_time;
-        // if(thread_with_earliest_deadline->current_deadline - args.current_time < allo_time) {
-        //     allo_time = thread_with_earliest_deadline->current_deadline - args.current_time;
-        // }
-
-        // list_for_each_entry(rqe, args.release_queue, thread_list) {
-        //     if (rqe->release_time + rqe->thrd->period == thread_with_earliest_deadline->current_deadline && rqe->thrd->ID < thread_with_earliest_deadline->ID) {
-        //         if(rqe->release_time - args.current_time < allo_time) {
-        //             allo_time = rqe->release_time - args.current_time;
-        //         }
-        //     }
-        //     else if (rqe->release_time + rqe->thrd->period < thread_with_earliest_deadline->current_deadline){
-        //         if(rqe->release_time - args.current_time < allo_time) {
-        //             allo_time = rqe->release_time - args.current_time;
-        //         }
-        //     }
-        // }
-
-        // int allo_time = 0;
-        list_for_each_entry(rqe, args.release_queue, thread_list) {
-            if (rqe->release_time + rqe->thrd->period == thread_with_earliest_deadline->current_deadline && rqe->thrd->ID < thread_with_earliest_deadline->ID) {
-                if(rqe->release_time < higher_rqe->release_time) {
-                    higher_rqe = rqe;
-                }
-            }
-            else if (rqe->release_time + rqe->thrd->period < thread_with_earliest_deadline->current_deadline){
-                if(rqe->release_time < higher_rqe->release_time) {
-                    higher_rqe = rqe;
-                }
-            }
-        }
+    return deadline < th->current_deadline ||
+           (deadline == th->current_deadline && rqe->thrd->ID < th->ID);
+}
 
-        int allo_time = higher_rqe->release_time - args.current_time;
-        if (thread_with_earliest_deadline->remaining_time < allo_time){
-            allo_time = thread_with_earliest_deadline->remaining_time;
-        }
-        if (thread_with_earliest_deadline->current_deadline - args.current_time < allo_time){
-            allo_time = thread_with_earliest_deadline->current_deadline - args.current_time;
+/* Does the release of rqe preempt th under RM? */
+static int rm_preempts(struct release_queue_entry *rqe, struct thread *th)
+{
+    return rqe->thrd->period < th->period ||
+           (rqe->thrd->period == th->period && rqe->thrd->ID < th->ID);
+}
+
+/*
+ * Per-thread statistics, indexed by thread ID: deadline misses
+ * and a histogram of response times (release to end of cycle)
+ * in power-of-two buckets of ticks. A cycle's end is known at
+ * dispatch, when the thread is given all of its remaining time.
+ */
+#define NHIST 8     // buckets: 0-1, 2-3, 4-7, ..., 128-
+
+struct sched_stat {
+    int used;
+    int cycles;
+    int misses;
+    int missed_deadline;    // deadline of the last miss counted
+    int worst;              // longest response time
+    int hist[NHIST];
+};
+
+static struct sched_stat *stats;
+static int nstats;
+
+static struct sched_stat *stat_of(int ID)
+{
+    if (ID >= nstats) {
+        int n = nstats ? nstats : 16;
+        while (n <= ID)
+            n *= 2;
+        struct sched_stat *s = malloc(n * sizeof(struct sched_stat));
+        if (s == NULL) {
+            printf("threads_sched: out of memory\n");
+            exit(1);
         }
+        memset(s, 0, n * sizeof(struct sched_stat));
+        memmove(s, stats, nstats * sizeof(struct sched_stat));
+        free(stats);
+        stats = s;
+        nstats = n;
+    }
+    stats[ID].used = 1;
+    return &stats[ID];
+}
+
+/* Record that th is dispatched at now for allocated_time ticks. */
+static void account(struct thread *th, int now, int allocated_time)
+{
+    struct sched_stat *s = stat_of(th->ID);
 
-        r.allocated_time = allo_time;
-        r.scheduled_thread_list_member = &thread_with_earliest_deadline->thread_list;
+    if (th->current_deadline <= now) {
+        if (s->misses == 0 || s->missed_deadline != th->current_deadline) {
+            s->misses++;
+            s->missed_deadline = th->current_deadline;
+        }
+        return;
     }
+    if (allocated_time < th->remaining_time)
+        return;
+    int response = now + th->remaining_time - (th->current_deadline - th->period);
+    int b = 0;
+    while (b < NHIST - 1 && response >= (2 << b))
+        b++;
+    s->cycles++;
+    s->hist[b]++;
+    if (response > s->worst)
+        s->worst = response;
+}
 
-    return r;
-    
-    // return schedule_default(args);
+/* Print the statistics of every thread scheduled so far. */
+void threads_sched_report(void)
+{
+    printf("thread\tcycles\tmisses\tworst\tresponse histogram (ticks 0-1, 2-3, 4-7, ...)\n");
+    for (int i = 0; i < nstats; i++) {
+        struct sched_stat *s = &stats[i];
+        if (!s->used)
+            continue;
+        printf("#%d\t%d\t%d\t%d\t", i, s->cycles, s->misses, s->worst);
+        for (int b = 0; b < NHIST; b++)
+            printf(" %d", s->hist[b]);
+        printf("\n");
+    }
 }
 
-/* Rate-Monotonic Scheduling */
-struct threads_sched_result schedule_rm(struct threads_sched_args args)
+/*
+ * Common part of the EDF and RM schedulers: one pass over the
+ * run queue for the thread to run, and one over the release
+ * queue for the earliest release that preempts it. Each
+ * decision is O(n); doing better needs the threading library,
+ * which owns both queues, to keep them ordered as it moves
+ * threads.
+ */
+static struct threads_sched_result schedule_rt(struct threads_sched_args args,
+        int (*before)(int, struct thread *, struct thread *),
+        int (*preempts)(struct release_queue_entry *, struct thread *))
 {
-    struct thread *thread_with_highest_rate = NULL;
+    struct threads_sched_result r;
+    struct thread *best = NULL;
     struct thread *th = NULL;
+    struct release_queue_entry *rqe = NULL;
+
     list_for_each_entry(th, args.run_queue, thread_list) {
-        if (thread_with_highest_rate == NULL){
-            thread_with_highest_rate = th;
-        }
-        else if (thread_with_highest_rate->current_deadline <= args.current_time){
-            if (th->ID < thread_with_highest_rate->ID){
-                thread_with_highest_rate = th;
-            }
-        }
-        else if ( (th->period == thread_with_highest_rate->period && th->ID < thread_with_highest_rate->ID) || (th->period < thread_with_highest_rate->period) ){
-            thread_with_highest_rate = th;
-        }
+        if (best == NULL || before(args.current_time, th, best))
+            best = th;
     }
 
-    struct threads_sched_result r;
-
-    if (thread_with_highest_rate == NULL){
-        struct release_queue_entry *higher_rqe = NULL;
-        struct release_queue_entry *rqe = NULL;
-        int release_time;
-
-        list_for_each_entry(rqe, args.release_queue, thread_list){
-            if (higher_rqe == NULL){
-                higher_rqe = rqe;
-            }
-            else if (rqe->release_time < higher_rqe->release_time){
-                higher_rqe = rqe;
-            }
+    // nothing to run: sleep until the next release.
+    if (best == NULL) {
+        struct release_queue_entry *next = NULL;
+        list_for_each_entry(rqe, args.release_queue, thread_list) {
+            if (next == NULL || rqe->release_time < next->release_time)
+                next = rqe;
         }
-        release_time = higher_rqe->release_time;
         r.scheduled_thread_list_member = args.run_queue;
-        r.allocated_time = release_time-args.current_time;
+        r.allocated_time = next ? next->release_time - args.current_time : 1;
+        return r;
     }
 
-    else if (thread_with_highest_rate->current_deadline <= args.current_time){
-        r.scheduled_thread_list_member = &thread_with_highest_rate->thread_list;
+    r.scheduled_thread_list_member = &best->thread_list;
+    if (best->current_deadline <= args.current_time) {
         r.allocated_time = 0;
+        account(best, args.current_time, 0);
+        return r;
     }
 
-    else{
-        struct release_queue_entry *higher_rqe = NULL;
-        struct release_queue_entry *rqe = NULL;
-        
-        list_for_each_entry(rqe, args.release_queue, thread_list) {
-            if (rqe->thrd->period == thread_with_highest_rate->period && rqe->thrd->ID < thread_with_highest_rate->ID){
-                if(rqe->release_time < higher_rqe->release_time){
-                    higher_rqe = rqe;
-                }
-            }
-
-            else if (rqe->thrd->period < thread_with_highest_rate->period){
-                if(rqe->release_time < higher_rqe->release_time){
-                    higher_rqe = rqe;
-                }
-            }
-        }
+    // run until best is done, hits its deadline, or a thread
+    // with higher priority is released.
+    int end = args.current_time + best->remaining_time;
+    if (best->current_deadline < end)
+        end = best->current_deadline;
+    list_for_each_entry(rqe, args.release_queue, thread_list) {
+        if (rqe->release_time < end && preempts(rqe, best))
+            end = rqe->release_time;
+    }
+    r.allocated_time = end - args.current_time;
+    account(best, args.current_time, r.allocated_time);
+    return r;
+}
 
-        int allo_time = higher_rqe->release_time - args.current_time;
-        if (thread_with_highest_rate->remaining_time < allo_time){
-            allo_time = thread_with_highest_rate->remaining_time;
-        }
-        if (thread_with_highest_rate->current_deadline - args.current_time < allo_time){
-            allo_time = thread_with_highest_rate->current_deadline - args.current_time;
+/* Earliest-Deadline-First scheduling */
+struct threads_sched_result schedule_edf(struct threads_sched_args args)
+{
+    return schedule_rt(args, edf_before, edf_preempts);
+}
+
+/* Rate-Monotonic Scheduling */
+struct threads_sched_result schedule_rm(struct threads_sched_args args)
+{
+    return schedule_rt(args, rm_before, rm_preempts);
+}
+
+/*
+ * Admission control.
+ *
+ * The threading library asks sched_admit() before it creates a
+ * periodic thread (processing time c every period p) and calls
+ * sched_leave() when the thread exits. A thread is refused if
+ * the admitted set would no longer be schedulable:
+ *  - EDF: total utilization U <= 1, computed exactly as a fraction.
+ *  - RM: U under the Liu-Layland bound n(2^(1/n) - 1), or else
+ *    exact response-time analysis of every thread.
+ * Other schedulers admit everything.
+ */
+struct sched_task {
+    int ID;
+    int c;
+    int p;
+};
+
+static struct sched_task *tasks;
+static int ntasks, taskcap;
+
+static uint64 gcd(uint64 a, uint64 b)
+{
+    while (b) {
+        uint64 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * Is the utilization of tasks plus (c, p) at most num/den?
+ * Fractions are exact while the common denominator fits; past
+ * that the sum is rounded up, which can only refuse more.
+ */
+static int utilization_below(int c, int p, uint64 num, uint64 den)
+{
+    uint64 un = c, ud = p;      // the sum, as un/ud
+    int exact = 1;
+
+    for (int i = 0; i < ntasks && exact; i++) {
+        uint64 g = gcd(ud, tasks[i].p);
+        if (ud / g > (1ULL << 40) / tasks[i].p) {
+            exact = 0;
+            break;
         }
+        un = un * (tasks[i].p / g) + tasks[i].c * (ud / g);
+        ud = ud / g * tasks[i].p;
+        g = gcd(un, ud);
+        un /= g;
+        ud /= g;
+    }
+    if (exact)
+        return un * den <= num * ud;
+
+    // in units of 2^-20, rounded up.
+    uint64 u = ((uint64)c << 20) / p + 1;
+    for (int i = 0; i < ntasks; i++)
+        u += ((uint64)tasks[i].c << 20) / tasks[i].p + 1;
+    return u * den <= (num << 20);
+}
 
-        // struct release_queue_entry *rqe = NULL;
+/* Liu-Layland bound n(2^(1/n) - 1) in thousandths, rounded down. */
+static int rm_bound(int n)
+{
+    static int bound[] = { 0, 1000, 828, 779, 756, 743, 734, 728, 724, 720, 717 };
+
+    return n <= 10 ? bound[n] : 693;
+}
 
-        // int allo_time = thread_with_highest_rate->remaining_time;
-        // if(thread_with_highest_rate->current_deadline - args.current_time < allo_time) {
-        //     allo_time = thread_with_highest_rate->current_deadline - args.current_time;
-        // }
+/* Does task a have higher RM priority than task b? */
+static int rm_higher(struct sched_task *a, struct sched_task *b)
+{
+    return a->p < b->p || (a->p == b->p && a->ID < b->ID);
+}
 
-        // list_for_each_entry(rqe, args.release_queue, thread_list) {
-        //     if (rqe->thrd->period == thread_with_highest_rate->current_deadline && rqe->thrd->ID < thread_with_highest_rate->ID) {
-        //         if(rqe->release_time - args.current_time < allo_time) {
-        //             allo_time = rqe->release_time - args.current_time;
-        //         }
-        //     }
-        //     else if (rqe->thrd->period < thread_with_highest_rate->current_deadline){
-        //         if(rqe->release_time - args.current_time < allo_time) {
-        //             allo_time = rqe->release_time - args.current_time;
-        //         }
-        //     }
-        // }
+/* Response-time analysis: does every task meet its deadline under RM? */
+static int rm_rta(void)
+{
+    for (int i = 0; i < ntasks; i++) {
+        struct sched_task *t = &tasks[i];
+        int r = t->c, prev = 0;
+        while (r != prev && r <= t->p) {
+            prev = r;
+            r = t->c;
+            for (int j = 0; j < ntasks; j++)
+                if (rm_higher(&tasks[j], t))
+                    r += (prev + tasks[j].p - 1) / tasks[j].p * tasks[j].c;
+        }
+        if (r > t->p)
+            return 0;
+    }
+    return 1;
+}
 
-        r.allocated_time = allo_time;
-        r.scheduled_thread_list_member = &thread_with_highest_rate->thread_list;
+/*
+ * Admit thread ID with processing time c and period p under
+ * scheduler sched. Returns 0 if admitted, -1 if refused.
+ */
+int sched_admit(struct threads_sched_result (*sched)(struct threads_sched_args),
+                int ID, int c, int p)
+{
+    if (c <= 0 || p <= 0 || c > p)
+        return -1;
+    if (sched == schedule_edf && !utilization_below(c, p, 1, 1))
+        return -1;
+
+    if (ntasks == taskcap) {
+        int cap = taskcap ? 2 * taskcap : 16;
+        struct sched_task *t = malloc(cap * sizeof(struct sched_task));
+        if (t == NULL)
+            return -1;
+        memmove(t, tasks, ntasks * sizeof(struct sched_task));
+        free(tasks);
+        tasks = t;
+        taskcap = cap;
+    }
+    // RM: the bound is only sufficient; past it, check exactly.
+    int rta = sched == schedule_rm && !utilization_below(c, p, rm_bound(ntasks + 1), 1000);
+    tasks[ntasks].ID = ID;
+    tasks[ntasks].c = c;
+    tasks[ntasks].p = p;
+    ntasks++;
+    if (rta && !rm_rta()) {
+        ntasks--;
+        return -1;
     }
+    return 0;
+}
 
-    return r;
-    // return schedule_default(args);
+/* Thread ID has exited: give its share back. */
+void sched_leave(int ID)
+{
+    for (int i = 0; i < ntasks; i++) {
+        if (tasks[i].ID == ID) {
+            tasks[i] = tasks[--ntasks];
+            return;
+        }
+    }
 }
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,6 +12,9 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To have blocks read in the background, for bread()s
+//     expected soon, call breadahead.
+// * To write several buffers at once, call bwriten.
 
 
 #include "types.h"
@@ -22,70 +25,180 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
+
+// Buffers are hashed by (dev, blockno) into NBUCKET buckets,
+// each with its own lock, so lookups of different blocks
+// rarely contend. bcache.lock only serializes recycling a
+// buffer from one bucket into another; brelse() stamps each
+// buffer with ticks so that recycling picks the least
+// recently used free buffer.
+#define NBUCKET 13
+#define BHASH(dev, blockno) ((((dev) << 27) | (blockno)) % NBUCKET)
 
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // Each bucket is a list of buffers through prev/next.
+  struct {
+    struct spinlock lock;
+    struct buf head;
+  } bucket[NBUCKET];
 } bcache;
 
+// Readahead statistics, see bcachestat().
+static struct {
+  uint64 ahead;   // blocks read by breadahead()
+  uint64 hits;    // of those, found by bread()
+  uint64 wasted;  // of those, recycled before bread() wanted them
+  uint64 misses;  // blocks bread() had to wait on the disk for
+} rastat;
+
 void
 binit(void)
 {
   struct buf *b;
 
   initlock(&bcache.lock, "bcache");
+  for(int i = 0; i < NBUCKET; i++){
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+    bcache.bucket[i].head.prev = &bcache.bucket[i].head;
+    bcache.bucket[i].head.next = &bcache.bucket[i].head;
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Start with all buffers in bucket 0.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+    b->next = bcache.bucket[0].head.next;
+    b->prev = &bcache.bucket[0].head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bcache.bucket[0].head.next->prev = b;
+    bcache.bucket[0].head.next = b;
   }
 }
 
+// Find the cached buffer for (dev, blockno) in bucket id.
+// Caller must hold that bucket's lock.
+static struct buf*
+bfind(int id, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.bucket[id].head.next; b != &bcache.bucket[id].head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  }
+  return 0;
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// For readahead, return 0 instead if the block is cached
+// already or there are few free buffers left; then bget()
+// never sleeps, and a buffer it returns is a fresh one.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int ra)
 {
-  struct buf *b;
+  struct buf *b, *victim;
+  int id = BHASH(dev, blockno);
+  int vid, nfree;
 
-  acquire(&bcache.lock);
+  // Is the block already cached? Readahead must not sleep on
+  // its lock, as it holds a disk plug, so it skips the block.
+  acquire(&bcache.bucket[id].lock);
+  if((b = bfind(id, dev, blockno)) != 0){
+    if(ra){
+      release(&bcache.bucket[id].lock);
+      return 0;
+    }
+    b->refcnt++;
+    release(&bcache.bucket[id].lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bcache.bucket[id].lock);
 
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
+  // Not cached. Only one process at a time may move buffers
+  // between buckets, so check again under bcache.lock in case
+  // someone else cached the block in the meantime.
+  acquire(&bcache.lock);
+  acquire(&bcache.bucket[id].lock);
+  if((b = bfind(id, dev, blockno)) != 0){
+    if(ra){
+      release(&bcache.bucket[id].lock);
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      return 0;
     }
+    b->refcnt++;
+    release(&bcache.bucket[id].lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bcache.bucket[id].lock);
 
-  // Not cached.
   // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+  // Keep the lock of the bucket holding the best candidate
+  // so far; only this process holds more than one bucket
+  // lock, so this cannot deadlock.
+  victim = 0;
+  vid = -1;
+  nfree = 0;
+  for(int i = 0; i < NBUCKET; i++){
+    int found = 0;
+    acquire(&bcache.bucket[i].lock);
+    for(b = bcache.bucket[i].head.next; b != &bcache.bucket[i].head; b = b->next){
+      if(b->refcnt == 0)
+        nfree++;
+      if(b->refcnt == 0 && (victim == 0 || b->timestamp < victim->timestamp)){
+        victim = b;
+        found = 1;
+      }
+    }
+    if(found){
+      if(vid >= 0)
+        release(&bcache.bucket[vid].lock);
+      vid = i;
+    } else {
+      release(&bcache.bucket[i].lock);
+    }
+  }
+  if(ra && victim && nfree <= NBUF/4){
+    // leave the last free buffers to bread().
+    release(&bcache.bucket[vid].lock);
+    victim = 0;
+  }
+  if(victim == 0){
+    if(ra){
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      return 0;
     }
+    panic("bget: no buffers");
   }
-  panic("bget: no buffers");
+
+  if(victim->ra){
+    __sync_fetch_and_add(&rastat.wasted, 1);
+    victim->ra = 0;
+  }
+  victim->dev = dev;
+  victim->blockno = blockno;
+  victim->valid = 0;
+  victim->refcnt = 1;
+  if(vid != id){
+    victim->next->prev = victim->prev;
+    victim->prev->next = victim->next;
+    release(&bcache.bucket[vid].lock);
+    acquire(&bcache.bucket[id].lock);
+    victim->next = bcache.bucket[id].head.next;
+    victim->prev = &bcache.bucket[id].head;
+    bcache.bucket[id].head.next->prev = victim;
+    bcache.bucket[id].head.next = victim;
+  }
+  release(&bcache.bucket[id].lock);
+  release(&bcache.lock);
+  acquiresleep(&victim->lock);
+  return victim;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -94,14 +207,88 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
+  if(b->ra){
+    // read ahead; the read may still be in progress.
+    virtio_disk_wait(b);
+    b->ra = 0;
+    b->valid = 1;
+    __sync_fetch_and_add(&rastat.hits, 1);
+  }
   if(!b->valid) {
     virtio_disk_rw(b, 0);
     b->valid = 1;
+    __sync_fetch_and_add(&rastat.misses, 1);
   }
   return b;
 }
 
+// Called by virtio_disk_intr() when a read started by
+// breadahead() is done.
+static void
+radone(struct buf *b)
+{
+  bunpin(b);
+}
+
+// Return a locked buf for the indicated block, filled with
+// zeros instead of read from disk, for a block that was
+// just allocated and is about to be written.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 0);
+  if(b->ra){
+    virtio_disk_wait(b);
+    b->ra = 0;
+  }
+  memset(b->data, 0, BSIZE);
+  b->valid = 1;
+  return b;
+}
+
+// Start reading the n blocks from blockno on into the cache,
+// skipping those that are there already, without waiting for
+// the disk. Returns how many blocks it got through, which is
+// less than n if it ran out of free buffers.
+int
+breadahead(uint dev, uint blockno, int n)
+{
+  struct buf *b;
+  int i;
+
+  virtio_disk_plug();
+  for(i = 0; i < n; i++, blockno++){
+    int id = BHASH(dev, blockno);
+    acquire(&bcache.bucket[id].lock);
+    b = bfind(id, dev, blockno);
+    release(&bcache.bucket[id].lock);
+    if(b)
+      continue;
+
+    if((b = bget(dev, blockno, 1)) == 0){
+      // someone else may have got there first.
+      acquire(&bcache.bucket[id].lock);
+      b = bfind(id, dev, blockno);
+      release(&bcache.bucket[id].lock);
+      if(b)
+        continue;
+      break;
+    }
+    b->ra = 1;
+    b->timestamp = ticks;
+    // the disk keeps our reference until the read is done;
+    // bread() waits for it under the buffer's lock.
+    virtio_disk_submit(b, 0, radone);
+    releasesleep(&b->lock);
+    __sync_fetch_and_add(&rastat.ahead, 1);
+  }
+  virtio_disk_unplug();
+  return i;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,43 +298,71 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Write the contents of the n buffers in b to disk, all at
+// once, so that the disk can merge writes of adjacent blocks.
+// Must all be locked.
+void
+bwriten(struct buf **b, int n)
+{
+  int i;
+
+  virtio_disk_plug();
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&b[i]->lock))
+      panic("bwriten");
+    virtio_disk_submit(b[i], 1, 0);
+  }
+  virtio_disk_unplug();
+  for(i = 0; i < n; i++)
+    virtio_disk_wait(b[i]);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Record when it was last used, for LRU recycling.
 void
 brelse(struct buf *b)
 {
+  int id;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  id = BHASH(b->dev, b->blockno);
+  acquire(&bcache.bucket[id].lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+    b->timestamp = ticks;
+  }
+  release(&bcache.bucket[id].lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int id = BHASH(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[id].lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bcache.bucket[id].lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int id = BHASH(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[id].lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bcache.bucket[id].lock);
 }
 
-
+// Copy the readahead statistics to st.
+void
+bcachestat(struct rastat *st)
+{
+  st->ahead = rastat.ahead;
+  st->hits = rastat.hits;
+  st->wasted = rastat.wasted;
+  st->misses = rastat.misses;
+}
@@ -1,12 +1,17 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int ra;      // read ahead by breadahead(), not yet used
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  uint timestamp;   // ticks at last brelse(), for LRU
+  struct buf *prev; // hash bucket list
   struct buf *next;
+  int iowrite;      // queued for writing? see virtio_disk_submit()
+  void (*iodone)(struct buf*); // called when the disk is done
+  struct buf *qnext; // disk queue, then disk request
   uchar data[BSIZE];
 };
 
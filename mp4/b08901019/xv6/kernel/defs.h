@@ -7,11 +7,19 @@ struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
+struct fsstat;
+struct rastat;
+struct logstat;
+struct dcstat;
 struct superblock;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bnew(uint, uint);
+int             breadahead(uint, uint, int);
+void            bwriten(struct buf**, int);
+void            bcachestat(struct rastat*);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
@@ -36,8 +44,12 @@ int             filewrite(struct file*, uint64, int n);
 
 // fs.c
 void            fsinit(int);
+void            bstat(int, struct fsstat*);
+void            bcommitted(void);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dcstat(struct dcstat*);
+void            dirunlink(struct inode*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
@@ -48,10 +60,15 @@ void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
+struct inode*   nameifollow(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             readlink(struct inode*, char*);
+uint            readahead(struct inode*, uint, uint);
+int             rawindow(int, struct rastat*);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
+int             writelink(struct inode*, char*);
 void            itrunc(struct inode*);
 
 // ramdisk.c
@@ -67,8 +84,12 @@ void            kinit(void);
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_ordered(struct buf*);
+void            logstat(struct logstat*);
 void            begin_op(void);
+void            begin_opn(int);
 void            end_op(void);
+void            end_opn(int);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -105,6 +126,7 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            kproc(void (*)(void), char*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -182,6 +204,10 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf *, int, void (*)(struct buf *));
+void            virtio_disk_wait(struct buf *);
+void            virtio_disk_plug(void);
+void            virtio_disk_unplug(void);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
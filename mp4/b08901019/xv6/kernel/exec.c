@@ -23,7 +23,7 @@ exec(char *path, char **argv)
 
   begin_op();
 
-  if((ip = namei(path)) == 0){
+  if((ip = nameifollow(path)) == 0){
     end_op();
     return -1;
   }
@@ -106,7 +106,7 @@ filestat(struct file *f, uint64 addr)
 int
 fileread(struct file *f, uint64 addr, int n)
 {
-  int r = 0;
+  int r = 0, seq;
 
   if(f->readable == 0)
     return -1;
@@ -119,8 +119,15 @@ fileread(struct file *f, uint64 addr, int n)
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
+    seq = f->off == f->ra_off;
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
+    // read ahead only for sequential readers.
+    if(seq && r > 0)
+      f->ra_end = readahead(f->ip, f->off, f->ra_end);
+    else
+      f->ra_end = 0;
+    f->ra_off = f->off;
     iunlock(f->ip);
   } else {
     panic("fileread");
@@ -156,15 +163,24 @@ filewrite(struct file *f, uint64 addr, int n)
     int i = 0;
     while(i < n){
       int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
 
-      begin_op();
+      // an append only adds new data blocks, which do not go
+      // through the log (see log_ordered()), so it can write
+      // more at a time. It still logs the inode, the block it
+      // starts in, up to 4 indirect or extent blocks, and a
+      // bitmap block for each of the blocks it allocates, if
+      // free space is fragmented: APPENDOPBLOCKS in all. The
+      // size is checked again under the lock; it may shrink.
+      int nlog = f->off >= f->ip->size ? APPENDOPBLOCKS : MAXOPBLOCKS;
+      begin_opn(nlog);
       ilock(f->ip);
+      int lim = nlog == APPENDOPBLOCKS && f->off >= f->ip->size ? MAXORDBLOCKS*BSIZE : max;
+      if(n1 > lim)
+        n1 = lim;
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
-      end_op();
+      end_opn(nlog);
 
       if(r != n1){
         // error from writei
@@ -6,6 +6,8 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  uint ra_off;       // FD_INODE: off after the last read
+  uint ra_end;       // FD_INODE: read ahead up to this block
   short major;       // FD_DEVICE
 };
 
@@ -25,6 +27,19 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+3]; // addrs[NDIRECT+1]; // TODO: bigfile. If you modify dinode, don't forget here.
+
+  struct dirindex *dix; // directory index, see dirlookup()
+
+  // block allocation, see iballoc().
+  uint lastblk;       // last block allocated to the inode
+  uint prealloc;      // next of the blocks set aside by writei()
+  int nprealloc;      // how many of those are left
+
+  // copy of the last indirect block of data block
+  // numbers bmap() looked at, see bmcache().
+  int bmc_valid;
+  uint bmc_first;     // file block number of bmc[0]
+  uint bmc[NINDIRECT];
 };
 
 // map major device number to device functions.
@@ -26,6 +26,12 @@
 // only one device
 struct superblock sb; 
 
+static void bsuminit(int);
+static void dixinit(void);
+static void dcinit(void);
+static void dcpurge(uint, uint);
+static void dixdrop(struct inode*);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +50,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit(dev);
 }
 
 // Zero a block.
@@ -59,30 +66,150 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// The allocator keeps, in memory, the number of free blocks
+// covered by each bitmap block, so it can skip full ones, and
+// a hint below which no block is free. Allocation is goal
+// directed: it starts looking at a block the caller would
+// like, normally the one after the inode's last, and hands
+// out a run of consecutive blocks when asked for several.
+//
+// New file data blocks are written to disk before the
+// transaction that allocates them commits, see log_ordered().
+// A block freed by the open transaction is not handed out
+// again until that commits: if the system crashed first, the
+// old file would still own it.
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+#define NBITMAP (FSSIZE/BPB + 1)
+
+struct {
+  struct spinlock lock;
+  uint nfree[NBITMAP];  // free blocks per bitmap block
+  uint hint;            // no block below this is free
+} bsum;
+
+// Blocks freed by the open transaction, a bit per block.
+// Written under the bitmap block's buffer lock, like the
+// bitmap itself.
+static uchar freed[FSSIZE/8 + 1];
+static int anyfreed;
+
+#define FREED(b) (freed[(b)/8] & (1 << ((b) % 8)))
+
+// Count the free blocks of dev.
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  int b, bi;
 
-  bp = 0;
+  if(sb.size > FSSIZE)
+    panic("bsuminit: file system too big");
+  initlock(&bsum.lock, "bsum");
+  bsum.hint = sb.size;
   for(b = 0; b < sb.size; b += BPB){
     bp = bread(dev, BBLOCK(b, sb));
     for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0){
+        bsum.nfree[b/BPB]++;
+        if(b + bi < bsum.hint)
+          bsum.hint = b + bi;
+      }
+    }
+    brelse(bp);
+  }
+}
+
+// Allocate up to n consecutive disk blocks, at goal if
+// it is free, else at the first free block after it, wrapping
+// around to the hint. Returns the first, and sets *got to how
+// many were allocated. Returns 0 if no block is free; blocks
+// freed by the open transaction don't count until it commits,
+// so the caller must fail the operation rather than wait.
+static uint
+balloc_run(uint dev, uint goal, int n, int *got)
+{
+  int b, bi, m, k, i;
+  int nb = (sb.size + BPB - 1) / BPB;
+  struct buf *bp;
+
+  if(goal >= sb.size || goal < bsum.hint)
+    goal = bsum.hint;
+  // the goal's bitmap block comes around twice: from the goal
+  // on first, and from its start last.
+  for(i = 0; i <= nb; i++){
+    b = (goal / BPB + i) % nb * BPB;
+    if(bsum.nfree[b/BPB] == 0)
+      continue;
+    bp = bread(dev, BBLOCK(b, sb));
+    bi = (i == 0) ? goal % BPB : 0;
+    for(; bi < BPB && b + bi < sb.size; bi++){
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
+      if((bp->data[bi/8] & m) == 0 && !FREED(b + bi)){  // Is block free?
+        for(k = 0; k < n && bi + k < BPB && b + bi + k < sb.size; k++){
+          m = 1 << ((bi + k) % 8);
+          if((bp->data[(bi + k)/8] & m) || FREED(b + bi + k))
+            break;
+          bp->data[(bi + k)/8] |= m;  // Mark block in use.
+        }
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        acquire(&bsum.lock);
+        bsum.nfree[b/BPB] -= k;
+        if(bsum.hint == b + bi)
+          bsum.hint = b + bi + k;
+        release(&bsum.lock);
+        *got = k;
         return b + bi;
       }
     }
     brelse(bp);
   }
-  panic("balloc: out of blocks");
+  *got = 0;
+  return 0;
+}
+
+// Allocate a disk block for ip, right after the last one if
+// possible, taking it from the blocks writei() set aside for
+// ip if there are any. The block is not zeroed; writei()
+// fills new data blocks, see bnew(). Returns 0 if the disk
+// is full.
+static uint
+iballoc(struct inode *ip)
+{
+  uint b;
+  int got;
+
+  if(ip->nprealloc > 0){
+    b = ip->prealloc++;
+    ip->nprealloc--;
+  } else if((b = balloc_run(ip->dev, ip->lastblk + 1, 1, &got)) == 0){
+    return 0;
+  }
+  ip->lastblk = b;
+  return b;
+}
+
+// Allocate a zeroed disk block for ip, for block numbers.
+static uint
+iballocz(struct inode *ip)
+{
+  uint b;
+
+  if((b = iballoc(ip)) != 0)
+    bzero(ip->dev, b);
+  return b;
+}
+
+// The open transaction has committed, so the blocks it
+// freed can be handed out again. Called by commit().
+void
+bcommitted(void)
+{
+  if(anyfreed){
+    memset(freed, 0, sizeof(freed));
+    anyfreed = 0;
+  }
 }
 
 // Free a disk block.
@@ -98,8 +225,42 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  freed[b/8] |= 1 << (b % 8);
+  anyfreed = 1;
   log_write(bp);
   brelse(bp);
+  acquire(&bsum.lock);
+  bsum.nfree[b/BPB]++;
+  if(b < bsum.hint)
+    bsum.hint = b;
+  release(&bsum.lock);
+}
+
+// Collect fragmentation statistics of the free space of dev.
+void
+bstat(int dev, struct fsstat *st)
+{
+  struct buf *bp;
+  int b, bi;
+  uint run = 0;
+
+  memset(st, 0, sizeof(*st));
+  st->nblocks = sb.nblocks;
+  for(b = 0; b < sb.size; b += BPB){
+    bp = bread(dev, BBLOCK(b, sb));
+    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+      if(bp->data[bi/8] & (1 << (bi % 8))){
+        run = 0;
+        continue;
+      }
+      st->nfree++;
+      if(run++ == 0)
+        st->nfreeruns++;
+      if(run > st->maxfreerun)
+        st->maxfreerun = run;
+    }
+    brelse(bp);
+  }
 }
 
 // Inodes.
@@ -182,6 +343,8 @@ iinit()
   int i = 0;
   
   initlock(&itable.lock, "itable");
+  dixinit();
+  dcinit();
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
   }
@@ -306,6 +469,10 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->bmc_valid = 0;
+    dixdrop(ip);
+    ip->lastblk = 0;
+    ip->nprealloc = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -371,35 +538,184 @@ iunlockput(struct inode *ip)
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
+//
+// On a file system made with FS_EXTENTS, ip->addrs[] holds
+// extents instead; see ebmap().
+
+// Number of entries at the start of a[0..n) whose blocks
+// follow each other on disk.
+static uint
+contig(uint *a, uint n)
+{
+  uint k;
+
+  for(k = 1; k < n && a[k] == a[0] + k; k++)
+    ;
+  return k;
+}
+
+// Find block bn in the n extents at e. Returns the index of
+// the extent holding it, with *bn made relative to its start,
+// or else the index of the first unused extent, with *bn made
+// relative to the end of the last used one.
+static int
+efind(struct extent *e, int n, uint *bn)
+{
+  int i;
+
+  for(i = 0; i < n && e[i].len; i++){
+    if(*bn < e[i].len)
+      return i;
+    *bn -= e[i].len;
+  }
+  return i;
+}
+
+// Add block addr to the end of the extents at e, of which
+// the first i are in use: grow the last one if addr follows
+// it, else start a new one. Returns 0 if all n are in use
+// and the last doesn't reach addr.
+static int
+eappend(struct extent *e, int i, int n, uint addr)
+{
+  if(i > 0 && e[i-1].start + e[i-1].len == addr){
+    e[i-1].len++;
+    return 1;
+  }
+  if(i == n)
+    return 0;
+  e[i].start = addr;
+  e[i].len = 1;
+  return 1;
+}
+
+// bmap() for inodes mapped by extents. Blocks are only ever
+// added at the end, so bn may be at most one past the last.
+// Returns 0 if the disk is full, or if a new block would need
+// an extent and all are in use, which badly fragmented files
+// can reach before MAXFILE.
+static uint
+ebmap(struct inode *ip, uint bn, uint *run)
+{
+  struct extent *e = (struct extent*)ip->addrs;
+  struct buf *bp;
+  uint addr;
+  int i;
+
+  i = efind(e, NEXTENT, &bn);
+  if(i < NEXTENT && e[i].len){
+    *run = e[i].len - bn;
+    return e[i].start + bn;
+  }
+  *run = 1;
+  if(ip->addrs[EXTENTIND] == 0){
+    if(bn != 0)
+      panic("ebmap: hole");
+    if((addr = iballoc(ip)) == 0)
+      return 0;
+    if(eappend(e, i, NEXTENT, addr))
+      return addr;
+    if((ip->addrs[EXTENTIND] = iballocz(ip)) == 0){
+      bfree(ip->dev, addr);
+      return 0;
+    }
+    bp = bread(ip->dev, ip->addrs[EXTENTIND]);
+    eappend((struct extent*)bp->data, 0, NIEXTENT, addr);
+    log_write(bp);
+    brelse(bp);
+    return addr;
+  }
+
+  bp = bread(ip->dev, ip->addrs[EXTENTIND]);
+  e = (struct extent*)bp->data;
+  i = efind(e, NIEXTENT, &bn);
+  if(i < NIEXTENT && e[i].len){
+    *run = e[i].len - bn;
+    addr = e[i].start + bn;
+  } else {
+    if(bn != 0)
+      panic("ebmap: hole");
+    if((addr = iballoc(ip)) != 0){
+      if(eappend(e, i, NIEXTENT, addr))
+        log_write(bp);
+      else {
+        bfree(ip->dev, addr);
+        addr = 0;
+      }
+    }
+  }
+  brelse(bp);
+  return addr;
+}
+
+// Block-map cache.
+//
+// Each in-memory inode keeps a copy of the last indirect
+// block of data block numbers (the singly-indirect block, or
+// a second-level block of a doubly-indirect tree) that bmap()
+// read, so consecutive blocks of a big file are translated
+// without going through the buffer cache for the indirect
+// blocks again. bmap() refreshes the copy whenever it reads
+// or changes such a block, and ilock() and itrunc() drop it.
+
+// Remember the indirect block a, which holds the disk block
+// numbers of file blocks first..first+NINDIRECT-1.
+static void
+bmcache(struct inode *ip, uint first, uint *a)
+{
+  memmove(ip->bmc, a, sizeof(ip->bmc));
+  ip->bmc_first = first;
+  ip->bmc_valid = 1;
+}
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one, or returns 0
+// if the file can't grow any more or the disk is full.
+// *run is set to the number of blocks from bn on that are
+// known to follow it on disk, at least 1.
 static uint
-bmap(struct inode *ip, uint bn)
+bmap(struct inode *ip, uint bn, uint *run)
 {
   // TODO: Large Files
   // You should modify bmap(),
   // so that it can handle doubly indrect inode.
-  uint addr, *a;
+  uint addr, *a, k;
   struct buf *bp;
 
+  if(sb.flags & FS_EXTENTS)
+    return ebmap(ip, bn, run);
+
+  *run = 1;
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = iballoc(ip);
+    else
+      *run = contig(&ip->addrs[bn], NDIRECT - bn);
+    return addr;
+  }
+
+  if(ip->bmc_valid && bn - ip->bmc_first < NINDIRECT &&
+     (addr = ip->bmc[(k = bn - ip->bmc_first)]) != 0){
+    *run = contig(&ip->bmc[k], NINDIRECT - k);
     return addr;
   }
+
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[NDIRECT]) == 0 &&
+       (ip->addrs[NDIRECT] = addr = iballocz(ip)) == 0)
+      return 0;
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
+      if((a[bn] = addr = iballoc(ip)) != 0)
+        log_write(bp);
+    } else {
+      *run = contig(&a[bn], NINDIRECT - bn);
     }
+    bmcache(ip, NDIRECT, a);
     brelse(bp);
     return addr;
   }
@@ -416,26 +732,32 @@ bmap(struct inode *ip, uint bn)
       uint level_2 = bn % NINDIRECT; // bn - level_1 * NINDIRECT;
 
       if((addr = ip->addrs[NDIRECT+(i+1)]) == 0){
-        ip->addrs[NDIRECT+(i+1)] = addr = balloc(ip->dev);
+        if((ip->addrs[NDIRECT+(i+1)] = addr = iballocz(ip)) == 0)
+          return 0;
       }
 
       bp = bread(ip->dev, addr);
       a = (uint*)bp->data;
 
       if((addr = a[level_1]) == 0){
-        a[level_1] = addr = balloc(ip->dev);
-        log_write(bp);
+        if((a[level_1] = addr = iballocz(ip)) != 0)
+          log_write(bp);
       }
 
       brelse(bp);
+      if(addr == 0)
+        return 0;
 
       bp = bread(ip->dev, addr);
       a = (uint*)bp->data;
 
       if((addr = a[level_2]) == 0){
-        a[level_2] = addr = balloc(ip->dev);
-        log_write(bp);
+        if((a[level_2] = addr = iballoc(ip)) != 0)
+          log_write(bp);
+      } else {
+        *run = contig(&a[level_2], NINDIRECT - level_2);
       }
+      bmcache(ip, NDIRECT + NINDIRECT + i*NDOUBLYINDIRECT + level_1*NINDIRECT, a);
 
       brelse(bp);
 
@@ -450,6 +772,40 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Free the blocks of the n extents at e.
+static void
+efree(uint dev, struct extent *e, int n)
+{
+  for(int i = 0; i < n && e[i].len; i++)
+    for(uint b = 0; b < e[i].len; b++)
+      bfree(dev, e[i].start + b);
+}
+
+// itrunc() for inodes mapped by extents.
+static void
+etrunc(struct inode *ip)
+{
+  struct buf *bp;
+
+  efree(ip->dev, (struct extent*)ip->addrs, NEXTENT);
+  if(ip->addrs[EXTENTIND]){
+    bp = bread(ip->dev, ip->addrs[EXTENTIND]);
+    efree(ip->dev, (struct extent*)bp->data, NIEXTENT);
+    brelse(bp);
+    bfree(ip->dev, ip->addrs[EXTENTIND]);
+  }
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+}
+
+// A symlink whose target is shorter than ip->addrs keeps the
+// target there instead of in a data block, so following it
+// needs no disk read once the inode is loaded.
+static int
+fastlink(struct inode *ip)
+{
+  return ip->type == T_SYMLINK && ip->size < sizeof(ip->addrs);
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
@@ -462,6 +818,23 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a, *_a;
 
+  ip->bmc_valid = 0;
+  dixdrop(ip);
+  if(ip->type == T_DIR)
+    dcpurge(ip->dev, ip->inum);
+  if(fastlink(ip)){
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
+  if(sb.flags & FS_EXTENTS){
+    etrunc(ip);
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -522,6 +895,35 @@ itrunc(struct inode *ip)
   iupdate(ip);
 }
 
+// Make target the target of the new symlink ip.
+// Caller must hold ip->lock.
+int
+writelink(struct inode *ip, char *target)
+{
+  uint n = strlen(target);
+
+  if(n < sizeof(ip->addrs)){
+    memmove(ip->addrs, target, n);
+    ip->size = n;
+    iupdate(ip);
+    return 0;
+  }
+  return writei(ip, 0, (uint64)target, 0, n) == n ? 0 : -1;
+}
+
+// Copy the target of symlink ip into buf, which has room
+// for MAXPATH bytes. Caller must hold ip->lock.
+int
+readlink(struct inode *ip, char *buf)
+{
+  uint n = ip->size < MAXPATH ? ip->size : MAXPATH - 1;
+
+  if(readi(ip, 0, (uint64)buf, 0, n) != n)
+    return -1;
+  buf[n] = 0;
+  return 0;
+}
+
 // Copy stat information from inode.
 // Caller must hold ip->lock.
 void
@@ -541,16 +943,23 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr, run;
   struct buf *bp;
 
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(fastlink(ip))
+    return either_copyout(user_dst, dst, (char*)ip->addrs + off, n) == -1 ? -1 : n;
 
+  // look blocks up a run of contiguous blocks at a time.
+  addr = run = 0;
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if(run == 0)
+      addr = bmap(ip, off/BSIZE, &run);
+    bp = bread(ip->dev, addr++);
+    run--;
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
@@ -562,6 +971,65 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Readahead window of sequential file readers, in blocks.
+// At most NBUF/2, so readahead cannot crowd everything
+// else out of the buffer cache.
+static int rawin = RAWINDOW;
+
+// Set the readahead window to window blocks, unless it is
+// negative, and copy the statistics to st. Returns the
+// previous window.
+int
+rawindow(int window, struct rastat *st)
+{
+  int old = rawin;
+
+  if(window > NBUF/2)
+    window = NBUF/2;
+  if(window >= 0)
+    rawin = window;
+  bcachestat(st);
+  st->window = old;
+  return old;
+}
+
+// A sequential reader of ip has got up to offset off, and
+// blocks before end were read ahead already. Start reading
+// the blocks of the window after off that were not, and
+// return how far that got. Does nothing until the reader
+// is half way through what was read ahead, so the disk
+// gets requests in batches.
+// Caller must hold ip->lock.
+uint
+readahead(struct inode *ip, uint off, uint end)
+{
+  uint bn, last, addr, run, n;
+
+  if(fastlink(ip))
+    return end;
+  bn = off / BSIZE;
+  last = (ip->size + BSIZE - 1) / BSIZE;
+  if(last > bn + rawin)
+    last = bn + rawin;
+  if(end < bn)
+    end = bn;
+  if(end > bn + rawin/2)
+    return end;
+
+  // blocks below ip->size are all allocated,
+  // so bmap() will not allocate any.
+  while(end < last){
+    addr = bmap(ip, end, &run);
+    if(run > last - end)
+      run = last - end;
+    n = breadahead(ip->dev, addr, run);
+    end += n;
+    if(n < run)
+      break;
+  }
+  return end;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -572,25 +1040,54 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr, run, nb, old;
   struct buf *bp;
+  int got, new;
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  // set aside one run of blocks for the ones the write adds.
+  old = (ip->size + BSIZE - 1) / BSIZE;
+  nb = (off + n + BSIZE - 1) / BSIZE;
+  if(nb > old && n > 0){
+    nb -= old;
+    ip->prealloc = balloc_run(ip->dev, ip->lastblk + 1, nb, &got);
+    ip->nprealloc = got;
+  }
+
+  addr = run = 0;
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if(run == 0 && (addr = bmap(ip, off/BSIZE, &run)) == 0)
+      break;
+    // blocks past the old end are new: nothing to read, and
+    // they go to disk directly instead of through the log.
+    new = off/BSIZE >= old;
+    if(new)
+      bp = bnew(ip->dev, addr++);
+    else
+      bp = bread(ip->dev, addr++);
+    run--;
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
       break;
     }
-    log_write(bp);
+    if(new)
+      log_ordered(bp);
+    else
+      log_write(bp);
     brelse(bp);
   }
 
+  // give back what the write didn't use.
+  while(ip->nprealloc > 0){
+    bfree(ip->dev, ip->prealloc++);
+    ip->nprealloc--;
+  }
+
   if(off > ip->size)
     ip->size = off;
 
@@ -610,6 +1107,400 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory index.
+//
+// Finding a name in a directory means reading its entries
+// one by one. For a directory of more than DIXMIN blocks,
+// dirlookup() instead builds, once, an in-memory hash table
+// from names to entry offsets and keeps it with the inode,
+// and dirlink() and dirunlink() keep it up to date. Small
+// directories are still searched linearly. The on-disk
+// format does not change, so programs like ls that read
+// directories keep working.
+//
+// A table is an array of pages of slots, each 0 (empty),
+// DIXTOMB (deleted), or the top 8 bits of the name's hash
+// above the entry's number plus one. It is owned by the
+// inode, under its lock; dixget() takes the table of an
+// unused inode when all NDIX are in use.
+
+#define DIXMIN     2     // index directories of more blocks than this
+#define NDIX       8     // tables in memory
+#define DIXPAGES   64    // max pages per table
+#define DIXSLOTS   (PGSIZE / sizeof(uint))  // slots per page
+#define DIXTOMB    0xffffffff
+
+struct dirindex {
+  struct inode *ip;   // owner, or 0 if free
+  int npages;         // a power of two
+  int nused;          // slots in use, deleted ones included
+  uint freeoff;       // no free entry below this offset
+  uint *page[DIXPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct dirindex dix[NDIX];
+} dixtab;
+
+static void
+dixinit(void)
+{
+  initlock(&dixtab.lock, "dixtab");
+}
+
+static uint
+dirhash(char *name)
+{
+  uint h = 2166136261;  // FNV-1a
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+static uint*
+dixslot(struct dirindex *x, uint i)
+{
+  i &= x->npages * DIXSLOTS - 1;
+  return &x->page[i / DIXSLOTS][i % DIXSLOTS];
+}
+
+static void
+dixfree(struct dirindex *x)
+{
+  for(int i = 0; i < x->npages; i++)
+    kfree(x->page[i]);
+  x->npages = 0;
+}
+
+// Drop ip's index, if it has one, e.g. because its
+// contents are being reloaded or discarded.
+static void
+dixdrop(struct inode *ip)
+{
+  struct dirindex *x = ip->dix;
+
+  if(x == 0)
+    return;
+  ip->dix = 0;
+  dixfree(x);
+  acquire(&dixtab.lock);
+  x->ip = 0;
+  release(&dixtab.lock);
+}
+
+// Allocate npages zeroed pages for x. Returns -1 if out of
+// memory.
+static int
+dixalloc(struct dirindex *x, int npages)
+{
+  for(x->npages = 0; x->npages < npages; x->npages++){
+    if((x->page[x->npages] = kalloc()) == 0){
+      dixfree(x);
+      return -1;
+    }
+    memset(x->page[x->npages], 0, PGSIZE);
+  }
+  x->nused = 0;
+  return 0;
+}
+
+// Get a free table for ip, taking one from an inode nobody
+// uses if there is none.
+static struct dirindex*
+dixget(struct inode *ip)
+{
+  struct dirindex *x, *victim = 0;
+
+  acquire(&dixtab.lock);
+  for(x = dixtab.dix; x < dixtab.dix + NDIX; x++){
+    if(x->ip == 0){
+      x->ip = ip;
+      release(&dixtab.lock);
+      return x;
+    }
+  }
+  // ref == 0 means no one holds the owner's lock,
+  // and iget() cannot hand it out while we hold itable.lock.
+  acquire(&itable.lock);
+  for(x = dixtab.dix; x < dixtab.dix + NDIX; x++){
+    if(x->ip->ref == 0){
+      x->ip->dix = 0;
+      x->ip = ip;
+      victim = x;
+      break;
+    }
+  }
+  release(&itable.lock);
+  release(&dixtab.lock);
+  if(victim)
+    dixfree(victim);
+  return victim;
+}
+
+// Add the entry for name at offset off to x. Returns -1 if
+// x is full and cannot grow, in which case the caller
+// should drop it.
+static int
+dixadd(struct dirindex *x, char *name, uint off)
+{
+  uint h = dirhash(name), *s;
+  uint v = (h & 0xff000000) | (off / sizeof(struct dirent) + 1);
+
+  if(2 * (x->nused + 1) > x->npages * DIXSLOTS){
+    // rehash into a table twice as big.
+    struct dirindex old = *x;
+    struct dirent de;
+    if(2 * old.npages > DIXPAGES || dixalloc(x, 2 * old.npages) < 0){
+      *x = old;
+      return -1;
+    }
+    for(uint i = 0; i < old.npages * DIXSLOTS; i++){
+      uint ov = *dixslot(&old, i);
+      if(ov == 0 || ov == DIXTOMB)
+        continue;
+      if(readi(x->ip, 0, (uint64)&de,
+               ((ov & 0xffffff) - 1) * sizeof(de), sizeof(de)) != sizeof(de))
+        panic("dixadd read");
+      for(uint j = dirhash(de.name); *(s = dixslot(x, j)); j++)
+        ;
+      *s = ov;
+      x->nused++;
+    }
+    dixfree(&old);
+  }
+  for(uint i = h; ; i++){
+    s = dixslot(x, i);
+    if(*s == 0 || *s == DIXTOMB)
+      break;
+  }
+  if(*s == 0)
+    x->nused++;
+  *s = v;
+  return 0;
+}
+
+// Build an index of directory dp. Returns 0 if there are no
+// resources for it.
+static struct dirindex*
+dixbuild(struct inode *dp)
+{
+  struct dirindex *x;
+  struct dirent de;
+  uint off, n;
+  int npages;
+
+  if((x = dixget(dp)) == 0)
+    return 0;
+  n = dp->size / sizeof(de);
+  for(npages = 1; npages * DIXSLOTS < 2 * n && npages < DIXPAGES; npages *= 2)
+    ;
+  if(dixalloc(x, npages) < 0)
+    goto bad;
+  x->freeoff = dp->size;
+  for(off = 0; off < dp->size; off += sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("dixbuild read");
+    if(de.inum == 0){
+      if(off < x->freeoff)
+        x->freeoff = off;
+      continue;
+    }
+    if(dixadd(x, de.name, off) < 0){
+      dixfree(x);
+      goto bad;
+    }
+  }
+  dp->dix = x;
+  return x;
+
+bad:
+  dp->dix = 0;
+  acquire(&dixtab.lock);
+  x->ip = 0;
+  release(&dixtab.lock);
+  return 0;
+}
+
+// Name cache.
+//
+// namex() and dirlookup() first look names up in a cache of
+// recent lookups, keyed by directory and name. An entry
+// with inum 0 records that the name is not there. dirlink()
+// and dirunlink() update the entries of the names they
+// change, and itrunc() drops those of a removed directory,
+// whose inode number may be reused. namex() trusts the cache
+// without locking the directory: it holds entries only for
+// directories.
+
+#define NDENTRY 256  // cached names
+#define NDHASH  67   // hash chains
+
+struct dentry {
+  uint dev;
+  uint dir;            // inode number of the directory
+  char name[DIRSIZ];
+  uint inum;           // 0 if name is not in dir
+  uint off;            // offset of its entry in dir
+  int used;
+  struct dentry *hnext;  // hash chain
+  struct dentry *prev;   // LRU list, most recent first
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry d[NDENTRY];
+  struct dentry *hash[NDHASH];
+  struct dentry lru;
+  struct dcstat stat;
+} dcache;
+
+static void
+dcinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.lru.prev = dcache.lru.next = &dcache.lru;
+  for(d = dcache.d; d < dcache.d + NDENTRY; d++){
+    d->next = dcache.lru.next;
+    d->prev = &dcache.lru;
+    dcache.lru.next->prev = d;
+    dcache.lru.next = d;
+  }
+}
+
+static struct dentry**
+dchash(uint dev, uint dir, char *name)
+{
+  return &dcache.hash[(dirhash(name) ^ (dir * 31) ^ dev) % NDHASH];
+}
+
+// Caller must hold dcache.lock.
+static struct dentry*
+dcfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = *dchash(dev, dir, name); d; d = d->hnext)
+    if(d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Move d to the front of the LRU list, or to the back if
+// it no longer holds a name. Caller must hold dcache.lock.
+static void
+dcmove(struct dentry *d, int front)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  if(front){
+    d->next = dcache.lru.next;
+    d->prev = &dcache.lru;
+  } else {
+    d->next = &dcache.lru;
+    d->prev = dcache.lru.prev;
+  }
+  d->next->prev = d;
+  d->prev->next = d;
+}
+
+// Caller must hold dcache.lock.
+static void
+dcunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = dchash(d->dev, d->dir, d->name); *pp != d; pp = &(*pp)->hnext)
+    ;
+  *pp = d->hnext;
+  d->used = 0;
+  dcmove(d, 0);
+}
+
+// Look name up in directory dir of dev in the cache.
+// Returns 1 and sets *inum (0 if the name is not there)
+// and *off, if off is not 0, if it is cached, else 0.
+// If ipp is not 0, *ipp is set to a reference to the inode,
+// or 0; it is taken under the cache lock, so that an unlink
+// can't free the inode before the caller gets to it.
+// Misses are counted by dirlookup(), as namex() may ask twice.
+static int
+dcget(uint dev, uint dir, char *name, uint *inum, uint *off, struct inode **ipp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    release(&dcache.lock);
+    return 0;
+  }
+  if(d->inum)
+    dcache.stat.hits++;
+  else
+    dcache.stat.neghits++;
+  dcmove(d, 1);
+  *inum = d->inum;
+  if(off)
+    *off = d->off;
+  if(ipp)
+    *ipp = d->inum ? iget(dev, d->inum) : 0;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in directory dir is inode inum, with
+// its entry at offset off, or is not there if inum is 0.
+static void
+dcput(uint dev, uint dir, char *name, uint inum, uint off)
+{
+  struct dentry *d, **pp;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    d = dcache.lru.prev;
+    if(d->used)
+      dcunhash(d);
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+    pp = dchash(dev, dir, name);
+    d->hnext = *pp;
+    *pp = d;
+    d->used = 1;
+  }
+  d->inum = inum;
+  d->off = off;
+  dcmove(d, 1);
+  release(&dcache.lock);
+}
+
+// Forget the names in directory dir.
+static void
+dcpurge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.d; d < dcache.d + NDENTRY; d++)
+    if(d->used && d->dev == dev && d->dir == dir)
+      dcunhash(d);
+  release(&dcache.lock);
+}
+
+// Copy the name cache statistics to st.
+void
+dcstat(struct dcstat *st)
+{
+  acquire(&dcache.lock);
+  *st = dcache.stat;
+  release(&dcache.lock);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
@@ -617,10 +1508,42 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
   struct dirent de;
+  struct dirindex *x;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcget(dp->dev, dp->inum, name, &inum, &off, 0)){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+  __sync_fetch_and_add(&dcache.stat.misses, 1);
+
+  x = dp->dix;
+  if(x == 0 && dp->size > DIXMIN * BSIZE)
+    x = dixbuild(dp);
+  if(x){
+    uint h = dirhash(name), v;
+    for(uint i = h; (v = *dixslot(x, i)) != 0; i++){
+      if(v == DIXTOMB || (v & 0xff000000) != (h & 0xff000000))
+        continue;
+      off = ((v & 0xffffff) - 1) * sizeof(de);
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlookup read");
+      if(de.inum != 0 && namecmp(name, de.name) == 0){
+        if(poff)
+          *poff = off;
+        dcput(dp->dev, dp->inum, name, de.inum, off);
+        return iget(dp->dev, de.inum);
+      }
+    }
+    dcput(dp->dev, dp->inum, name, 0, 0);
+    return 0;
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -631,14 +1554,17 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcput(dp->dev, dp->inum, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
 
+  dcput(dp->dev, dp->inum, name, 0, 0);
   return 0;
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
+// Returns -1 if the name is present or the disk is full.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
@@ -653,7 +1579,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
+  for(off = dp->dix ? dp->dix->freeoff : 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlink read");
     if(de.inum == 0)
@@ -663,11 +1589,44 @@ dirlink(struct inode *dp, char *name, uint inum)
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("dirlink");
+    return -1;
+  dcput(dp->dev, dp->inum, name, inum, off);
 
+  if(dp->dix){
+    dp->dix->freeoff = off + sizeof(de);
+    if(dixadd(dp->dix, name, off) < 0)
+      dixdrop(dp);
+  }
   return 0;
 }
 
+// Remove the directory entry at offset off from dp.
+void
+dirunlink(struct inode *dp, uint off)
+{
+  struct dirent de;
+  struct dirindex *x = dp->dix;
+
+  if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink read");
+  dcput(dp->dev, dp->inum, de.name, 0, 0);
+  if(x){
+    uint h = dirhash(de.name), *s;
+    for(uint i = h; *(s = dixslot(x, i)) != 0; i++){
+      if(*s != DIXTOMB && (*s & 0xffffff) == off / sizeof(de) + 1){
+        *s = DIXTOMB;
+        break;
+      }
+    }
+    if(off < x->freeoff)
+      x->freeoff = off;
+  }
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink");
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -707,80 +1666,79 @@ skipelem(char *path, char *name)
   return path;
 }
 
+#define MAXLINKS 20  // symlinks followed in one path name
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
+// Symlinks are followed in every element but the final one, and
+// in that one too if follow is set.
 // Must be called inside a transaction since it calls iput().
 static struct inode*
-namex(char *path, int nameiparent, char *name)
+namex(char *path, int nameiparent, int follow, char *name)
 {
-  // TODO: Symbolic Link to Directories
-  // Modify this function to deal with symbolic links to directories.
   struct inode *ip, *next;
+  char buf[MAXPATH], link[MAXPATH];
+  int nlinks = 0;
+  uint inum, n;
   
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
     ip = idup(myproc()->cwd);
 
+  // ip is always a directory here: the elements looked up
+  // so far were checked to be directories or were followed.
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
-
-    // SymLink
-    if(ip->type == T_SYMLINK){
-
-      int check = 0;
-
-      for(int i=0; i<20; i++){ // depth of links threshold = 20
-
-        char target_path[MAXPATH];
-
-        if (readi(ip, 0, (uint64)target_path, 0, MAXPATH) < 0){
-          break;
-        }
-
-        iunlockput(ip);
-
-        if ((ip = namei(target_path)) == 0){
-          check = 1;
-          break;
-        }
-
-        ilock(ip);
-
-        if (ip->type != T_SYMLINK){
-          check = 2;
-          break;
-        }
-        
-      }
+    if(nameiparent && *path == '\0'){
+      // Stop one level early.
+      return ip;
+    }
+    // A cached name needs neither ilock() nor dirlookup().
+    if(!dcget(ip->dev, ip->inum, name, &inum, 0, &next)){
+      ilock(ip);
+      next = dirlookup(ip, name, 0);
+      iunlock(ip);
+    }
+    if(next == 0){
+      iput(ip);
+      return 0;
+    }
+    if(*path == '\0' && !follow){
+      iput(ip);
+      return next;
+    }
 
-      if(check == 0){
-        iunlockput(ip);
-        end_op();
+    ilock(next);
+    if(next->type == T_SYMLINK){
+      // go on with the target and then the rest of path,
+      // from the directory holding the link.
+      if(++nlinks > MAXLINKS || readlink(next, link) < 0 || link[0] == 0 ||
+         (n = strlen(link)) + 1 + strlen(path) >= MAXPATH){
+        iunlockput(next);
+        iput(ip);
         return 0;
       }
-      if(check == 1){
-        end_op();
-        return 0;
+      iunlockput(next);
+      if(*path){
+        link[n++] = '/';
+        safestrcpy(link + n, path, MAXPATH - n);
       }
-
-    }
-
-    if(ip->type != T_DIR){
-      iunlockput(ip);
-      return 0;
-    }
-    if(nameiparent && *path == '\0'){
-      // Stop one level early.
-      iunlock(ip);
-      return ip;
+      safestrcpy(buf, link, MAXPATH);
+      path = buf;
+      if(*path == '/'){
+        iput(ip);
+        ip = iget(ROOTDEV, ROOTINO);
+      }
+      continue;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+    if(*path != '\0' && next->type != T_DIR){
+      iunlockput(next);
+      iput(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlock(next);
+    iput(ip);
     ip = next;
   }
   if(nameiparent){
@@ -794,11 +1752,20 @@ struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
-  return namex(path, 0, name);
+  return namex(path, 0, 0, name);
+}
+
+// Like namei(), but if path names a symlink, return the
+// inode it leads to.
+struct inode*
+nameifollow(char *path)
+{
+  char name[DIRSIZ];
+  return namex(path, 0, 1, name);
 }
 
 struct inode*
 nameiparent(char *path, char *name)
 {
-  return namex(path, 1, name);
+  return namex(path, 1, 0, name);
 }
\ No newline at end of file
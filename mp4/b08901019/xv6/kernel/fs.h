@@ -20,10 +20,13 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint flags;        // FS_* feature flags, chosen by mkfs
 };
 
 #define FSMAGIC 0x10203040
 
+#define FS_EXTENTS 0x1  // inodes map their blocks with extents
+
 // TODO: bigfile
 // You may need to modify these.
 #define NDIRECT 10 // 12 (direct -> doubly-indirect)
@@ -42,6 +45,19 @@ struct dinode {
   uint addrs[NDIRECT+3]; // addrs[NDIRECT+1];   // Data block addresses
 };
 
+// On a file system made with FS_EXTENTS, an inode's addrs[]
+// instead holds NEXTENT extents, runs of consecutive blocks
+// that follow each other in the file, and addrs[EXTENTIND]
+// the number of a block holding NIEXTENT more.
+struct extent {
+  uint start;           // first block of the run
+  uint len;             // number of blocks; 0 if unused
+};
+
+#define NEXTENT ((NDIRECT+2) / 2)
+#define EXTENTIND (NDIRECT+2)
+#define NIEXTENT (BSIZE / sizeof(struct extent))
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -1,6 +1,13 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Each hart keeps its own free list so that kalloc() and
+// kfree() normally only touch a lock no other hart wants.
+// A hart whose list runs dry refills KMEM_BATCH pages at a
+// time from a shared pool, and one whose list grows past
+// 2*KMEM_BATCH hands a batch back. If the pool is empty too,
+// kalloc() steals half of another hart's list.
 
 #include "types.h"
 #include "param.h"
@@ -9,6 +16,8 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define KMEM_BATCH 32  // pages moved between a hart and the pool at once
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -18,15 +27,21 @@ struct run {
   struct run *next;
 };
 
-struct {
+struct kmem {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;
+};
+
+struct kmem kmem[NCPU];  // per-hart free lists
+struct kmem kpool;       // shared pool that refills them
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kmem[i].lock, "kmem");
+  initlock(&kpool.lock, "kmem_pool");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -39,6 +54,64 @@ freerange(void *pa_start, void *pa_end)
     kfree(p);
 }
 
+// Detach up to n pages from the front of km's free list
+// and return them as a chain. Caller must hold km->lock.
+static struct run*
+takepages(struct kmem *km, int n, int *got)
+{
+  struct run *head, *r;
+  int i;
+
+  head = km->freelist;
+  if(head == 0){
+    *got = 0;
+    return 0;
+  }
+  r = head;
+  for(i = 1; i < n && r->next; i++)
+    r = r->next;
+  km->freelist = r->next;
+  km->nfree -= i;
+  r->next = 0;
+  *got = i;
+  return head;
+}
+
+// Prepend a chain of n pages ending at tail to km's free list.
+// Caller must hold km->lock.
+static void
+putpages(struct kmem *km, struct run *head, struct run *tail, int n)
+{
+  tail->next = km->freelist;
+  km->freelist = head;
+  km->nfree += n;
+}
+
+// Fetch a batch of pages for hart id, first from the pool and
+// then by stealing from another hart. Holds at most one
+// kmem lock at a time, so there is no lock ordering to get wrong.
+static struct run*
+refill(int id, int *got)
+{
+  struct run *r;
+
+  acquire(&kpool.lock);
+  r = takepages(&kpool, KMEM_BATCH, got);
+  release(&kpool.lock);
+  if(r)
+    return r;
+
+  for(int i = 1; i < NCPU; i++){
+    struct kmem *victim = &kmem[(id + i) % NCPU];
+    acquire(&victim->lock);
+    r = takepages(victim, (victim->nfree + 1) / 2, got);
+    release(&victim->lock);
+    if(r)
+      return r;
+  }
+  return 0;
+}
+
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
@@ -46,7 +119,9 @@ freerange(void *pa_start, void *pa_end)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *spill;
+  struct kmem *km;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
@@ -56,10 +131,25 @@ kfree(void *pa)
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  km = &kmem[cpuid()];
+  acquire(&km->lock);
+  r->next = km->freelist;
+  km->freelist = r;
+  km->nfree++;
+  spill = 0;
+  if(km->nfree > 2*KMEM_BATCH)
+    spill = takepages(km, KMEM_BATCH, &n);
+  release(&km->lock);
+  pop_off();
+
+  if(spill){
+    for(r = spill; r->next; r = r->next)
+      ;
+    acquire(&kpool.lock);
+    putpages(&kpool, spill, r, n);
+    release(&kpool.lock);
+  }
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,13 +158,33 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  struct run *r, *rest, *tail;
+  struct kmem *km;
+  int id, n;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  km = &kmem[id];
+  acquire(&km->lock);
+  r = km->freelist;
+  if(r){
+    km->freelist = r->next;
+    km->nfree--;
+  }
+  release(&km->lock);
+
+  if(r == 0 && (r = refill(id, &n)) != 0){
+    // keep the first page, stash the rest locally.
+    rest = r->next;
+    if(rest){
+      for(tail = rest; tail->next; tail = tail->next)
+        ;
+      acquire(&km->lock);
+      putpages(km, rest, tail, n - 1);
+      release(&km->lock);
+    }
+  }
+  pop_off();
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -21,6 +22,14 @@
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
 //
+// The last end_op() does not commit right away unless the
+// log (or the list of ordered blocks) is half full, someone
+// waits for space, or the
+// transaction is LOGDELAY ticks old, so that more system
+// calls can join the transaction and blocks they all write,
+// like the bitmap, get logged once. The logflush kernel
+// process commits transactions left open that long.
+//
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
@@ -28,7 +37,10 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous, but the blocks of a commit
+// are written LOGBATCH at a time, see bwriten().
+
+#define LOGBATCH 8
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -41,15 +53,23 @@ struct log {
   struct spinlock lock;
   int start;
   int size;
+  int cap;         // max blocks per transaction
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks they may still write, in all.
   int committing;  // in commit(), please wait.
+  int waiting;     // how many begin_op()s wait for space.
+  uint opened;     // ticks when the transaction logged its first block.
   int dev;
   struct logheader lh;
+  int nord;        // new data blocks to write before commit,
+  int ord[ORDSIZE];  // see log_ordered()
+  struct logstat stat;
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void logflush(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -60,25 +80,37 @@ initlog(int dev, struct superblock *sb)
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  log.cap = log.size - 1 < LOGSIZE ? log.size - 1 : LOGSIZE;
+  if (log.cap < APPENDOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
   recover_from_log();
+  kproc(logflush, "logflush");
 }
 
 // Copy committed blocks from log to their home location
 static void
 install_trans(int recovering)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  struct buf *dbuf[LOGBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      struct buf *lbuf = bread(log.dev, log.start+tail+i+1); // read log block
+      dbuf[i] = bread(log.dev, log.lh.block[tail+i]); // read dst
+      memmove(dbuf[i]->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    }
+    bwriten(dbuf, n);  // write dst to disk
+    for (i = 0; i < n; i++) {
+      if(recovering == 0)
+        bunpin(dbuf[i]);
+      brelse(dbuf[i]);
+    }
   }
 }
 
@@ -122,39 +154,89 @@ recover_from_log(void)
   write_head(); // clear the log
 }
 
-// called at the start of each FS system call.
+// Commit the transaction, which nobody is in any more.
+// Caller holds log.lock, which is released while committing.
+static void
+flush(void)
+{
+  log.committing = 1;
+  release(&log.lock);
+  // call commit w/o holding locks, since not allowed
+  // to sleep with locks.
+  commit();
+  acquire(&log.lock);
+  log.committing = 0;
+  wakeup(&log);
+}
+
+// called at the start of each FS system call that may
+// write up to n blocks through the log.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  uint t0 = 0;
+  int waited = 0;
+
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + n > log.cap){
+      if(log.outstanding == 0){
+        // an open transaction nobody is in; commit it ourselves.
+        flush();
+        continue;
+      }
       // this op might exhaust log space; wait for commit.
+      if(!waited){
+        waited = 1;
+        t0 = ticks;
+      }
+      log.waiting++;
       sleep(&log, &log.lock);
+      log.waiting--;
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      if(waited){
+        log.stat.waits++;
+        log.stat.waitticks += ticks - t0;
+      }
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call, with the n
+// given to begin_opn().
 // commits if this was the last outstanding operation.
 void
-end_op(void)
+end_opn(int n)
 {
   int do_commit = 0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= n;
+  log.stat.ops++;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+  if(log.outstanding == 0 && log.lh.n > 0){
+    // commit now, or leave the transaction open for
+    // more system calls to join?
+    do_commit = log.waiting > 0 || 2*log.lh.n >= log.cap ||
+                2*log.nord >= ORDSIZE || ticks - log.opened >= LOGDELAY;
+  }
+  if(do_commit){
+    flush();
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -162,43 +244,119 @@ end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
+void
+end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// Body of the logflush kernel process: commit transactions
+// nobody has joined for LOGDELAY ticks.
+static void
+logflush(void)
+{
+  uint t0;
+
+  acquire(&log.lock);
+  for(;;){
+    // wait for a transaction to be opened.
+    while(log.lh.n == 0)
+      sleep(&log.opened, &log.lock);
+    t0 = log.opened;
     release(&log.lock);
+
+    acquire(&tickslock);
+    while(ticks - t0 < LOGDELAY)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    acquire(&log.lock);
+    if(log.lh.n > 0 && log.opened == t0){
+      if(log.outstanding == 0 && !log.committing)
+        flush();
+      else
+        // a system call is in the transaction, and its
+        // end_op() will see that it is old and commit it,
+        // or it is being committed; either way wakes us.
+        sleep(&log, &log.lock);
+    }
+  }
+}
+
+// Copy the commit statistics to st.
+void
+logstat(struct logstat *st)
+{
+  acquire(&log.lock);
+  *st = log.stat;
+  st->size = log.cap;
+  release(&log.lock);
+}
+
+// Write the new data blocks recorded by log_ordered() to
+// their home locations, before the blocks that point to
+// them are logged.
+static void
+write_ordered(void)
+{
+  struct buf *b[LOGBATCH];
+  int i, k, n;
+
+  for (i = 0; i < log.nord; i += n) {
+    n = log.nord - i;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    for (k = 0; k < n; k++)
+      b[k] = bread(log.dev, log.ord[i+k]);
+    bwriten(b, n);
+    for (k = 0; k < n; k++) {
+      bunpin(b[k]);
+      brelse(b[k]);
+    }
   }
+  log.nord = 0;
 }
 
 // Copy modified blocks from cache to log.
+// The log blocks are consecutive, so each batch
+// goes to the disk as one request.
 static void
 write_log(void)
 {
-  int tail;
+  struct buf *to[LOGBATCH];
+  int tail, i, n;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      to[i] = bread(log.dev, log.start+tail+i+1); // log block
+      struct buf *from = bread(log.dev, log.lh.block[tail+i]); // cache block
+      memmove(to[i]->data, from->data, BSIZE);
+      brelse(from);
+    }
+    bwriten(to, n);  // write the log
+    for (i = 0; i < n; i++)
+      brelse(to[i]);
   }
 }
 
 static void
 commit()
 {
+  write_ordered();   // Write new data blocks home first
   if (log.lh.n > 0) {
+    log.stat.commits++;
+    log.stat.blocks += log.lh.n;
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
     install_trans(0); // Now install writes to home locations
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
+    bcommitted();    // Blocks it freed can be reused
   }
 }
 
@@ -217,7 +375,7 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -228,9 +386,49 @@ log_write(struct buf *b)
   }
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
+    if (log.lh.n == 0) {
+      log.opened = ticks;
+      wakeup(&log.opened);  // start logflush()'s timer
+    }
     bpin(b);
     log.lh.n++;
+  } else {
+    log.stat.absorbed++;
   }
   release(&log.lock);
 }
 
+// Caller has filled b, a block the current transaction
+// allocated for file data, and is done with the buffer.
+// Instead of going through the log, the block goes straight
+// to its home location, before the transaction commits; a
+// crash before then leaves it in a block that is still free.
+// Pins b in the cache until commit()/write_ordered().
+void
+log_ordered(struct buf *b)
+{
+  int i;
+
+  acquire(&log.lock);
+  if (log.outstanding < 1)
+    panic("log_ordered outside of trans");
+  for (i = 0; i < log.nord; i++) {
+    if (log.ord[i] == b->blockno)
+      break;
+  }
+  if (i < log.nord) {
+    release(&log.lock);
+    return;
+  }
+  log.stat.ordered++;
+  if (log.nord < ORDSIZE) {
+    log.ord[log.nord++] = b->blockno;
+    bpin(b);
+    release(&log.lock);
+    return;
+  }
+  release(&log.lock);
+
+  // no room left on the list: write it now.
+  bwrite(b);
+}
@@ -7,8 +7,13 @@
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGSIZE      (MAXOPBLOCKS*10) // max data blocks in on-disk log
+#define LOGDELAY     3  // ticks a transaction may wait for more system calls
+#define ORDSIZE      128  // max unlogged new data blocks per transaction
+#define MAXORDBLOCKS 16   // max new data blocks an FS op writes at once
+#define APPENDOPBLOCKS (MAXORDBLOCKS+10) // max # of blocks such an op logs
+#define NBUF         (LOGSIZE+ORDSIZE+MAXOPBLOCKS*3)  // size of disk block cache
+#define RAWINDOW     8  // default file readahead window, in blocks
 // TODO: bigfile. You need 200000 FSSIZE to finish Large Files.
 #define FSSIZE       200000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
@@ -17,6 +17,7 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void kprocret(void);
 
 extern char trampoline[]; // trampoline.S
 
@@ -163,6 +164,7 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kfn = 0;
   p->state = UNUSED;
 }
 
@@ -247,6 +249,22 @@ userinit(void)
   release(&p->lock);
 }
 
+// Start a kernel process that runs fn(), which must never
+// return, and never goes to user space.
+void
+kproc(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kproc");
+  p->context.ra = (uint64)kprocret;
+  p->kfn = fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -523,6 +541,17 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel process's very first scheduling by scheduler()
+// will swtch to kprocret.
+static void
+kprocret(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+  myproc()->kfn();
+  panic("kprocret");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
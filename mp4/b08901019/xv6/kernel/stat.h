@@ -10,3 +10,39 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// Free space of a file system, see fsstat().
+struct fsstat {
+  uint nblocks;    // Number of data blocks
+  uint nfree;      // Number of free blocks
+  uint nfreeruns;  // Number of runs of consecutive free blocks
+  uint maxfreerun; // Length of the longest such run
+};
+
+// File readahead statistics, see rastat().
+struct rastat {
+  int window;      // Readahead window, in blocks
+  uint64 ahead;    // Blocks read ahead
+  uint64 hits;     // Blocks read ahead and then read
+  uint64 wasted;   // Blocks read ahead and evicted unread
+  uint64 misses;   // Blocks read waiting on the disk
+};
+
+// Log commit statistics, see logstat().
+struct logstat {
+  int size;          // Max blocks per transaction
+  uint64 commits;    // Transactions committed
+  uint64 blocks;     // Blocks they logged
+  uint64 ops;        // File system calls in them
+  uint64 absorbed;   // Writes to blocks logged already
+  uint64 ordered;    // New data blocks written home, unlogged
+  uint64 waits;      // begin_op()s that waited for log space
+  uint64 waitticks;  // Ticks spent waiting
+};
+
+// Name cache statistics, see dcstat().
+struct dcstat {
+  uint64 hits;     // Names found in the cache
+  uint64 neghits;  // Names the cache knew were not there
+  uint64 misses;   // Names looked up in the directory
+};
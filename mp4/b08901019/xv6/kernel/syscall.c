@@ -105,6 +105,10 @@ extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
 extern uint64 sys_symlink(void);
+extern uint64 sys_fsstat(void);
+extern uint64 sys_rastat(void);
+extern uint64 sys_logstat(void);
+extern uint64 sys_dcstat(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -129,6 +133,10 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_symlink]   sys_symlink,
+[SYS_fsstat]    sys_fsstat,
+[SYS_rastat]    sys_rastat,
+[SYS_logstat]   sys_logstat,
+[SYS_dcstat]    sys_dcstat,
 };
 
 void
@@ -20,4 +20,8 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
-#define SYS_symlink 22
\ No newline at end of file
+#define SYS_symlink 22
+#define SYS_fsstat  23
+#define SYS_rastat  24
+#define SYS_logstat 25
+#define SYS_dcstat  26
\ No newline at end of file
@@ -185,7 +185,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -215,9 +214,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -268,19 +265,32 @@ create(char *path, short type, short major, short minor)
   iupdate(ip);
 
   if(type == T_DIR){  // Create . and .. entries.
-    dp->nlink++;  // for ".."
-    iupdate(dp);
     // No ip->nlink++ for ".": avoid cyclic ref count.
     if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
-      panic("create dots");
+      goto fail;
   }
 
+  // the disk may be full, or its last blocks only freed by
+  // this transaction.
   if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+    goto fail;
+
+  if(type == T_DIR){
+    dp->nlink++;  // for ".."
+    iupdate(dp);
+  }
 
   iunlockput(dp);
 
   return ip;
+
+ fail:
+  // de-allocate ip.
+  ip->nlink = 0;
+  iupdate(ip);
+  iunlockput(ip);
+  iunlockput(dp);
+  return 0;
 }
 
 uint64
@@ -310,7 +320,11 @@ sys_open(void)
       return -1;
     }
   } else {
-    if((ip = namei(path)) == 0){
+    if(omode & O_NOFOLLOW)
+      ip = namei(path);
+    else
+      ip = nameifollow(path);
+    if(ip == 0){
       end_op();
       return -1;
     }
@@ -320,48 +334,11 @@ sys_open(void)
       end_op();
       return -1;
     }
-
-    // SymLink
-    if(ip->type == T_SYMLINK && omode != O_NOFOLLOW){
-
-      int check = 0;
-
-      for(int i=0; i<20; i++){ // depth of links threshold = 20
-
-        char target_path[MAXPATH];
-
-        if (readi(ip, 0, (uint64)target_path, 0, MAXPATH) < 0){
-          break;
-        }
-
-        iunlockput(ip);
-
-        if ((ip = namei(target_path)) == 0){
-          check = 1;
-          break;
-        }
-
-        ilock(ip);
-
-        if (ip->type != T_SYMLINK){
-          check = 2;
-          break;
-        }
-        
-      }
-
-      if(check == 0){
-        iunlockput(ip);
-        end_op();
-        return -1;
-      }
-      if(check == 1){
-        end_op();
-        return -1;
-      }
-
+    if(ip->type == T_SYMLINK && (omode & (O_WRONLY|O_RDWR))){
+      iunlockput(ip);
+      end_op();
+      return -1;
     }
-
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
@@ -384,6 +361,7 @@ sys_open(void)
   } else {
     f->type = FD_INODE;
     f->off = 0;
+    f->ra_off = f->ra_end = 0;
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
@@ -447,53 +425,11 @@ sys_chdir(void)
   struct proc *p = myproc();
   
   begin_op();
-  if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
+  if(argstr(0, path, MAXPATH) < 0 || (ip = nameifollow(path)) == 0){
     end_op();
     return -1;
   }
   ilock(ip);
-
-  // SymLink
-  if(ip->type == T_SYMLINK){
-
-    int check = 0;
-
-    for(int i=0; i<20; i++){ // depth of links threshold = 20
-
-      char target_path[MAXPATH];
-
-      if (readi(ip, 0, (uint64)target_path, 0, MAXPATH) < 0){
-        break;
-      }
-
-      iunlockput(ip);
-
-      if ((ip = namei(target_path)) == 0){
-        check = 1;
-        break;
-      }
-
-      ilock(ip);
-
-      if (ip->type != T_SYMLINK){
-        check = 2;
-        break;
-      }
-      
-    }
-
-    if(check == 0){
-      iunlockput(ip);
-      end_op();
-      return -1;
-    }
-    if(check == 1){
-      end_op();
-      return -1;
-    }
-
-  }
-
   if(ip->type != T_DIR){
     iunlockput(ip);
     end_op();
@@ -600,7 +536,7 @@ sys_symlink(void)
     return -1;
   }
 
-  if((writei(ip, 0, (uint64)target, 0, MAXPATH)) < 0){
+  if(writelink(ip, target) < 0){
     iunlockput(ip);
     end_op();
     return -1;
@@ -609,4 +545,65 @@ sys_symlink(void)
   iunlockput(ip);
   end_op();
   return 0;
-}
\ No newline at end of file
+}
+
+// Report how fragmented the free space of the root file system is.
+uint64
+sys_fsstat(void)
+{
+  struct fsstat st;
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  bstat(ROOTDEV, &st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Set the file readahead window and report readahead statistics.
+uint64
+sys_rastat(void)
+{
+  struct rastat st;
+  int window, old;
+  uint64 addr;
+
+  if(argint(0, &window) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  old = rawindow(window, &st);
+  if(addr != 0 && copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return old;
+}
+
+// Report statistics of log commits.
+uint64
+sys_logstat(void)
+{
+  struct logstat st;
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  logstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Report statistics of the name cache.
+uint64
+sys_dcstat(void)
+{
+  struct dcstat st;
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  dcstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
@@ -5,6 +5,16 @@
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// callers queue buffers with virtio_disk_submit(), which does
+// not wait, and either wait for them with virtio_disk_wait()
+// or have virtio_disk_intr() call a function when they are
+// done. queued buffers are handed to the device as soon as
+// there are descriptors for them; a buffer for the block
+// right after another queued one in the same direction
+// goes in the same device request. virtio_disk_plug() holds
+// back the queue while a caller submits a batch, so that
+// its blocks can be merged this way.
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -20,6 +30,9 @@
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// at most this many buffers per device request.
+#define NMERGE 16
+
 static struct disk {
   // the virtio driver and device mostly communicate through a set of
   // structures in RAM. pages[] allocates that memory. pages[] is a
@@ -55,16 +68,23 @@ static struct disk {
 
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
+  int nfree;       // how many are
   uint16 used_idx; // we've looked this far in used[2..NUM].
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b;  // buffers of the request, through qnext
     char status;
   } info[NUM];
 
+  // buffers submitted but not yet handed to the device,
+  // oldest first, through qnext.
+  struct buf *qhead;
+  struct buf *qtail;
+  int plugged;     // nesting depth of virtio_disk_plug()
+
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
@@ -136,6 +156,7 @@ virtio_disk_init(void)
   // all NUM descriptors start out unused.
   for(int i = 0; i < NUM; i++)
     disk.free[i] = 1;
+  disk.nfree = NUM;
 
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
@@ -147,6 +168,7 @@ alloc_desc()
   for(int i = 0; i < NUM; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
+      disk.nfree--;
       return i;
     }
   }
@@ -166,7 +188,7 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  disk.nfree++;
 }
 
 // free a chain of descriptors.
@@ -184,43 +206,45 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
-static int
-alloc3_desc(int *idx)
+// take the queued buffer for blockno in direction write
+// off the queue, if there is one.
+static struct buf*
+unqueue(uint blockno, int write)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
+  struct buf *b, *prev;
+
+  prev = 0;
+  for(b = disk.qhead; b; prev = b, b = b->qnext){
+    if(b->blockno == blockno && b->iowrite == write){
+      if(prev)
+        prev->qnext = b->qnext;
+      else
+        disk.qhead = b->qnext;
+      if(disk.qtail == b)
+        disk.qtail = prev;
+      b->qnext = 0;
+      return b;
     }
   }
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// hand the n buffers of consecutive blocks in the list
+// starting at b to the device as one request.
+static void
+start(struct buf *b, int n)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  int write = b->iowrite;
+  int idx[NMERGE+2];
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+  // one descriptor for type/reserved/sector, then the data,
+  // then one for a 1-byte status result. the data may be
+  // spread over several descriptors.
+  for(int i = 0; i < n+2; i++)
+    idx[i] = alloc_desc();
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -230,30 +254,32 @@ virtio_disk_rw(struct buf *b, int write)
   else
     buf0->type = VIRTIO_BLK_T_IN; // read the disk
   buf0->reserved = 0;
-  buf0->sector = sector;
+  buf0->sector = b->blockno * (BSIZE / 512);
 
   disk.desc[idx[0]].addr = (uint64) buf0;
   disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  struct buf *x = b;
+  for(int i = 1; i <= n; i++, x = x->qnext){
+    disk.desc[idx[i]].addr = (uint64) x->data;
+    disk.desc[idx[i]].len = BSIZE;
+    if(write)
+      disk.desc[idx[i]].flags = 0; // device reads x->data
+    else
+      disk.desc[idx[i]].flags = VRING_DESC_F_WRITE; // device writes x->data
+    disk.desc[idx[i]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i]].next = idx[i+1];
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
+  // record the buffers for virtio_disk_intr().
   disk.info[idx[0]].b = b;
 
   // tell the device the first index in our chain of descriptors.
@@ -267,15 +293,91 @@ virtio_disk_rw(struct buf *b, int write)
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+// hand queued buffers to the device while there are
+// descriptors for them, merging each with the queued
+// buffers for the blocks right after it.
+// caller holds vdisk_lock.
+static void
+dispatch(void)
+{
+  struct buf *b, *last, *x;
+  int n;
+
+  while((b = disk.qhead) != 0 && disk.nfree >= 3){
+    disk.qhead = b->qnext;
+    if(disk.qhead == 0)
+      disk.qtail = 0;
+    b->qnext = 0;
+    last = b;
+    for(n = 1; n < NMERGE && n+2 < disk.nfree; n++){
+      if((x = unqueue(last->blockno+1, b->iowrite)) == 0)
+        break;
+      last->qnext = x;
+      last = x;
+    }
+    start(b, n);
   }
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// queue a transfer of b, which the caller has locked.
+// returns without waiting for it; when the disk is done,
+// virtio_disk_intr() calls done(b) if done is not 0, with
+// interrupts off and so without sleeping.
+void
+virtio_disk_submit(struct buf *b, int write, void (*done)(struct buf *))
+{
+  acquire(&disk.vdisk_lock);
+  b->disk = 1;
+  b->iowrite = write;
+  b->iodone = done;
+  b->qnext = 0;
+  if(disk.qtail)
+    disk.qtail->qnext = b;
+  else
+    disk.qhead = b;
+  disk.qtail = b;
+  if(disk.plugged == 0)
+    dispatch();
+  release(&disk.vdisk_lock);
+}
+
+// wait for the transfer of b to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  // b may be held back by a plug.
+  dispatch();
+  while(b->disk == 1)
+    sleep(b, &disk.vdisk_lock);
+  release(&disk.vdisk_lock);
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(b, write, 0);
+  virtio_disk_wait(b);
+}
+
+// hold back buffers submitted from now on until the
+// matching virtio_disk_unplug().
+void
+virtio_disk_plug(void)
+{
+  acquire(&disk.vdisk_lock);
+  disk.plugged++;
+  release(&disk.vdisk_lock);
+}
 
+void
+virtio_disk_unplug(void)
+{
+  acquire(&disk.vdisk_lock);
+  if(--disk.plugged == 0)
+    dispatch();
   release(&disk.vdisk_lock);
 }
 
@@ -304,12 +406,26 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    struct buf *b, *next;
+    for(b = disk.info[id].b; b; b = next){
+      void (*done)(struct buf *) = b->iodone;
+      next = b->qnext;
+      b->qnext = 0;
+      b->disk = 0;   // disk is done with buf
+      wakeup(b);
+      if(done)
+        done(b);
+    }
+    disk.info[id].b = 0;
+    free_chain(id);
 
     disk.used_idx += 1;
   }
 
+  // descriptors were freed; start what was waiting for them,
+  // plugged or not: a plug holder may be asleep, and so may
+  // someone waiting for a buffer already in the queue.
+  dispatch();
+
   release(&disk.vdisk_lock);
 }
@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE+1;  // header and LOGSIZE blocks, unless -l
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -31,6 +31,7 @@ struct superblock sb;
 char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
+int extents;  // map file blocks with extents (-e)
 
 
 void balloc(int);
@@ -40,6 +41,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+uint ebmap(struct dinode *din, uint fbn);
 
 // convert to intel byte order
 ushort
@@ -76,8 +78,29 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  while(argc > 1 && argv[1][0] == '-'){
+    if(strcmp(argv[1], "-e") == 0){
+      extents = 1;
+    } else if(strcmp(argv[1], "-l") == 0 && argc > 2){
+      // the kernel uses at most LOGSIZE blocks after the header,
+      // and needs room for one MAXOPBLOCKS system call.
+      nlog = atoi(argv[2]);
+      if(nlog < MAXOPBLOCKS+1 || nlog > LOGSIZE+1){
+        fprintf(stderr, "mkfs: log must be %d to %d blocks\n",
+                MAXOPBLOCKS+1, LOGSIZE+1);
+        exit(1);
+      }
+      argc--;
+      argv++;
+    } else {
+      break;
+    }
+    argc--;
+    argv++;
+  }
+
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-e] [-l nlog] fs.img files...\n");
     exit(1);
   }
 
@@ -102,6 +125,7 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.flags = xint(extents ? FS_EXTENTS : 0);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -276,7 +300,9 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
+    if(extents){
+      x = ebmap(&din, fbn);
+    } else if(fbn < NDIRECT){
       if(xint(din.addrs[fbn]) == 0){
         din.addrs[fbn] = xint(freeblock++);
       }
@@ -303,3 +329,27 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Block fbn of the extent-mapped inode din, allocating it
+// if it is just past the end. Only direct extents are used.
+uint
+ebmap(struct dinode *din, uint fbn)
+{
+  struct extent *e = (struct extent*)din->addrs;
+  int i;
+
+  for(i = 0; i < NEXTENT && e[i].len; i++){
+    if(fbn < xint(e[i].len))
+      return xint(e[i].start) + fbn;
+    fbn -= xint(e[i].len);
+  }
+  assert(fbn == 0);
+  if(i > 0 && xint(e[i-1].start) + xint(e[i-1].len) == freeblock){
+    e[i-1].len = xint(xint(e[i-1].len) + 1);
+    return freeblock++;
+  }
+  assert(i < NEXTENT);
+  e[i].start = xint(freeblock);
+  e[i].len = xint(1);
+  return freeblock++;
+}
@@ -0,0 +1,22 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Print statistics of the name cache.
+int
+main(int argc, char *argv[])
+{
+  struct dcstat st;
+  uint64 n;
+
+  if(dcstat(&st) < 0){
+    fprintf(2, "dcstat: failed\n");
+    exit(1);
+  }
+  n = st.hits + st.neghits + st.misses;
+  printf("name cache: %d hits, %d negative hits, %d misses\n",
+         (int)st.hits, (int)st.neghits, (int)st.misses);
+  if(n > 0)
+    printf("%d%% of lookups hit\n", (int)((st.hits + st.neghits) * 100 / n));
+  exit(0);
+}
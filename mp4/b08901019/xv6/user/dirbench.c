@@ -0,0 +1,99 @@
+// Time creating, looking up and removing many names in one
+// directory, for a small and a big directory. With the
+// directory index, the time per name should not grow with
+// the size of the directory.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+// Make the name of the i'th entry, with prefix c.
+void
+mkname(char *buf, char c, int i)
+{
+  buf[0] = c;
+  for(int k = 5; k >= 1; k--){
+    buf[k] = '0' + i % 10;
+    i /= 10;
+  }
+  buf[6] = 0;
+}
+
+void
+bench(int n)
+{
+  char name[8];
+  int fd, i, t0, t1, t2, t3, t4;
+
+  if(mkdir("dirbench.d") < 0 || chdir("dirbench.d") < 0){
+    printf("dirbench: cannot make dirbench.d\n");
+    exit(1);
+  }
+  // the names are links to one file, so they need no inodes.
+  if((fd = open("f", O_CREATE|O_RDWR)) < 0){
+    printf("dirbench: cannot create f\n");
+    exit(1);
+  }
+  close(fd);
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    mkname(name, 'n', i);
+    if(link("f", name) < 0){
+      printf("dirbench: link %s failed\n", name);
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  for(i = 0; i < n; i++){
+    mkname(name, 'n', i);
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("dirbench: open %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+  t2 = uptime();
+  for(i = 0; i < n; i++){
+    mkname(name, 'x', i);
+    if(open(name, O_RDONLY) >= 0){
+      printf("dirbench: open %s should fail\n", name);
+      exit(1);
+    }
+  }
+  t3 = uptime();
+  for(i = 0; i < n; i++){
+    mkname(name, 'n', i);
+    if(unlink(name) < 0){
+      printf("dirbench: unlink %s failed\n", name);
+      exit(1);
+    }
+  }
+  t4 = uptime();
+
+  unlink("f");
+  chdir("..");
+  if(unlink("dirbench.d") < 0){
+    printf("dirbench: cannot remove dirbench.d\n");
+    exit(1);
+  }
+  printf("%d names: link %d, open %d, open missing %d, unlink %d ticks\n",
+         n, t1 - t0, t2 - t1, t3 - t2, t4 - t3);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 10000;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 10 || n > 99999){
+    printf("usage: dirbench [names]\n");
+    exit(1);
+  }
+  bench(n / 10);
+  bench(n);
+  exit(0);
+}
@@ -0,0 +1,18 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Print how fragmented the free space of the file system is.
+int
+main(int argc, char *argv[])
+{
+  struct fsstat st;
+
+  if(fsstat(&st) < 0){
+    fprintf(2, "fsstat: failed\n");
+    exit(1);
+  }
+  printf("blocks %d free %d free runs %d longest run %d\n",
+         st.nblocks, st.nfree, st.nfreeruns, st.maxfreerun);
+  exit(0);
+}
@@ -0,0 +1,23 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Print statistics of log commits.
+int
+main(int argc, char *argv[])
+{
+  struct logstat st;
+
+  if(logstat(&st) < 0){
+    fprintf(2, "logstat: failed\n");
+    exit(1);
+  }
+  printf("log %d blocks: %d commits, %d blocks, %d ops, %d absorbed\n",
+         st.size, (int)st.commits, (int)st.blocks, (int)st.ops, (int)st.absorbed);
+  if(st.commits > 0)
+    printf("%d blocks and %d ops per commit\n",
+           (int)(st.blocks / st.commits), (int)(st.ops / st.commits));
+  printf("%d data blocks bypassed the log\n", (int)st.ordered);
+  printf("%d waits for log space, %d ticks\n", (int)st.waits, (int)st.waitticks);
+  exit(0);
+}
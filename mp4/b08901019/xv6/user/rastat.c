@@ -0,0 +1,26 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Print file readahead statistics, after setting the
+// readahead window if one is given.
+int
+main(int argc, char *argv[])
+{
+  struct rastat st;
+  int window = -1;
+
+  if(argc > 2){
+    fprintf(2, "Usage: rastat [window]\n");
+    exit(1);
+  }
+  if(argc == 2)
+    window = atoi(argv[1]);
+  if(rastat(window, &st) < 0){
+    fprintf(2, "rastat: failed\n");
+    exit(1);
+  }
+  printf("window %d ahead %d hits %d wasted %d misses %d\n",
+         st.window, (int)st.ahead, (int)st.hits, (int)st.wasted, (int)st.misses);
+  exit(0);
+}
@@ -1,4 +1,8 @@
 struct stat;
+struct fsstat;
+struct rastat;
+struct logstat;
+struct dcstat;
 struct rtcdate;
 
 // system calls
@@ -24,6 +28,10 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int symlink(char *target, char *path);
+int fsstat(struct fsstat*);
+int rastat(int, struct rastat*);
+int logstat(struct logstat*);
+int dcstat(struct dcstat*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -37,3 +37,7 @@ entry("sbrk");
 entry("sleep");
 entry("uptime");
 entry("symlink");
+entry("fsstat");
+entry("rastat");
+entry("logstat");
+entry("dcstat");